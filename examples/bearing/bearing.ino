@@ -23,7 +23,7 @@ void setup() {
 void loop() {
   compass.read();
 
-  byte a = compass.getAzimuth();
+  int a = compass.getAzimuth();
   // Output here will be a value from 0 - 15 based on the direction of the bearing / azimuth.
   byte b = compass.getBearing(a);
   
@@ -0,0 +1,69 @@
+/*
+===============================================================================================================
+Timing harness for the QMC5883LCompass benchmark example sketch.
+
+benchRun() calls a function n times and returns the average time per call in ns. Times are converted to CPU
+cycles with the clock of the board. micros() only has a resolution of a few us on some boards (4us on AVR),
+so use enough calls to make that small compared to the total.
+===============================================================================================================
+*/
+#ifndef QMC5883L_BENCH_H
+#define QMC5883L_BENCH_H
+
+#include <Arduino.h>
+
+// Board name for the report.
+#if defined(__AVR__)
+#define BENCH_BOARD "AVR"
+#elif defined(ARDUINO_ARCH_SAMD)
+#define BENCH_BOARD "SAMD"
+#elif defined(ESP32)
+#define BENCH_BOARD "ESP32"
+#elif defined(ESP8266)
+#define BENCH_BOARD "ESP8266"
+#elif defined(ARDUINO_ARCH_RP2040)
+#define BENCH_BOARD "RP2040"
+#else
+#define BENCH_BOARD "unknown"
+#endif
+
+// Results are written here so the compiler can't drop the code being timed.
+volatile long benchSink;
+
+// CPU clock in MHz, 0 if unknown.
+uint32_t benchCpuMHz() {
+#if defined(ESP32)
+  return getCpuFrequencyMhz();
+#elif defined(F_CPU)
+  return F_CPU / 1000000UL;
+#else
+  return 0;
+#endif
+}
+
+// Average time per call of fn in ns over n calls.
+template <typename F>
+uint32_t benchRun(F fn, uint16_t n) {
+  uint32_t start = micros();
+  for (uint16_t i = 0; i < n; i++) {
+    fn();
+  }
+  uint32_t us = micros() - start;
+  return (uint64_t)us * 1000 / n;
+}
+
+// Print a time in ns as "name: 12.345 us, 678 cycles".
+void benchPrint(const char* name, long ns) {
+  Serial.print(name);
+  Serial.print(": ");
+  Serial.print(ns / 1000.0, 3);
+  Serial.print(" us");
+  if (benchCpuMHz()) {
+    Serial.print(", ");
+    Serial.print(ns * (long)benchCpuMHz() / 1000);
+    Serial.print(" cycles");
+  }
+  Serial.println();
+}
+
+#endif
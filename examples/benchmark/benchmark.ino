@@ -0,0 +1,157 @@
+/*
+===============================================================================================================
+QMC5883LCompass.h Library Benchmark Example Sketch
+Learn more at [https://github.com/mprograms/QMC5883LCompass]
+
+Measures what the library costs on your board and prints a report to the serial monitor:
+
+1. I2C transactions at 100kHz and 400kHz. Each read mode and the data ready check.
+2. Per-sample processing. Every filter and calibration mode is timed as the extra time it adds to read(),
+   which leaves the I2C time out.
+3. Heading math. getAzimuth(), getBearing() and getDirection().
+4. Sustained samples per second for every output data rate, with and without streaming.
+
+Runs on AVR, SAMD, ESP32, RP2040 and other boards. Times are averages over many calls. Compare runs on
+the same board to check the effect of a change.
+
+===============================================================================================================
+Release under the GNU General Public License v3
+[https://www.gnu.org/licenses/gpl-3.0.en.html]
+===============================================================================================================
+*/
+#include <QMC5883LCompass.h>
+#include "bench.h"
+
+#define RUNS 200
+
+QMC5883LCompass compass;
+long baseline;
+
+void benchRead(const char* name) {
+  long ns = benchRun([]() { compass.read(); }, RUNS);
+  benchPrint(name, ns - baseline);
+}
+
+void benchI2C(uint32_t clock) {
+  Wire.setClock(clock);
+  Serial.print("-- I2C at ");
+  Serial.print(clock / 1000);
+  Serial.println("kHz");
+
+  compass.setStreaming(false);
+  benchPrint("read()", benchRun([]() { compass.read(); }, RUNS));
+  benchPrint("available()", benchRun([]() { benchSink = compass.available(); }, RUNS));
+  compass.setStreaming(true);
+  benchPrint("read() streaming", benchRun([]() { compass.read(); }, RUNS));
+  compass.setStreaming(true, true);
+  benchPrint("read() streaming + temperature", benchRun([]() { compass.read(); }, RUNS));
+  compass.setStreaming(false);
+}
+
+void benchProcessing() {
+  Serial.println("-- Processing per sample, on top of read()");
+  Wire.setClock(400000);
+  compass.setStreaming(true);
+
+#if QMC5883L_ENABLE_CALIBRATION
+  compass.clearCalibration();
+#endif
+#if QMC5883L_ENABLE_SMOOTHING
+  compass.setFilter(QMC5883L_FILTER_NONE);
+#endif
+  baseline = 0;
+  baseline = benchRun([]() { compass.read(); }, RUNS);
+  benchPrint("read() without calibration and smoothing", baseline);
+
+#if QMC5883L_ENABLE_CALIBRATION
+  compass.setCalibrationOffsets(120.5, -80.25, 40);
+  compass.setCalibrationScales(1.05, 0.97, 0.99);
+  benchRead("calibration offsets + scales");
+#if QMC5883L_ENABLE_CALIBRATION_MATRIX
+  const float matrix[3][3] = {{1.02, 0.03, -0.01}, {0.03, 0.98, 0.02}, {-0.01, 0.02, 1.0}};
+  compass.setCalibrationMatrix(matrix);
+  benchRead("calibration matrix");
+#endif
+  compass.clearCalibration();
+#endif
+
+#if QMC5883L_ENABLE_SMOOTHING
+#if QMC5883L_SMOOTH_MAX_STEPS
+  compass.setSmoothing(QMC5883L_SMOOTH_MAX_STEPS, false);
+  benchRead("smoothing, max steps");
+  compass.setSmoothing(QMC5883L_SMOOTH_MAX_STEPS, true);
+  benchRead("smoothing, max steps, advanced");
+#endif
+  compass.setFilter(QMC5883L_FILTER_EMA, 3);
+  benchRead("EMA filter");
+  compass.setFilter(QMC5883L_FILTER_LOWPASS, 5);
+  benchRead("low-pass filter");
+  compass.setFilter(QMC5883L_FILTER_MEDIAN3);
+  benchRead("median-of-3 filter");
+  compass.setFilter(QMC5883L_FILTER_NONE);
+#endif
+
+  compass.setStreaming(false);
+}
+
+void benchHeading() {
+  Serial.println("-- Heading");
+  compass.read();
+  char direction[3];
+  // The azimuth is cached per sample. Setting the declination drops the cache, so each run
+  // works out the azimuth again, with a few cycles of overhead.
+  benchPrint("getAzimuth()", benchRun([]() { compass.setMagneticDeclination(0, 0); benchSink = compass.getAzimuth(); }, RUNS));
+  benchPrint("getAzimuthCentidegrees()", benchRun([]() { compass.setMagneticDeclination(0, 0); benchSink = compass.getAzimuthCentidegrees(); }, RUNS));
+  benchPrint("getAzimuth(), cached", benchRun([]() { benchSink = compass.getAzimuth(); }, RUNS));
+  benchPrint("getBearing()", benchRun([]() { benchSink = compass.getBearing(benchSink & 0xFF); }, RUNS));
+  benchPrint("getDirection()", benchRun([&direction]() { compass.getDirection(direction, benchSink & 0xFF); benchSink = direction[0]; }, RUNS));
+}
+
+void benchRate() {
+  static const byte odrs[4] = {0x00, 0x04, 0x08, 0x0C};
+  static const int hz[4] = {10, 50, 100, 200};
+
+  Serial.println("-- Sustained samples per second");
+  for (int streaming = 0; streaming < 2; streaming++) {
+    compass.setStreaming(streaming);
+    for (int i = 0; i < 4; i++) {
+      compass.setMode(0x01, odrs[i], 0x10, 0x00);
+      unsigned long start = millis();
+      long samples = 0;
+      while (millis() - start < 1000) {
+        samples += compass.readIfReady();
+      }
+      Serial.print(hz[i]);
+      Serial.print("Hz");
+      Serial.print(streaming ? " streaming" : "");
+      Serial.print(": ");
+      Serial.print(samples);
+      Serial.println(" samples/s");
+    }
+  }
+  compass.setStreaming(false);
+  compass.setMode(0x01, 0x0C, 0x10, 0x00);
+}
+
+void setup() {
+  Serial.begin(115200);
+  while (!Serial && millis() < 3000) {}
+  compass.init();
+
+  Serial.print("QMC5883LCompass benchmark on ");
+  Serial.print(BENCH_BOARD);
+  Serial.print(", ");
+  Serial.print(benchCpuMHz());
+  Serial.println("MHz");
+
+  benchI2C(100000);
+  benchI2C(400000);
+  benchProcessing();
+  benchHeading();
+  benchRate();
+
+  Serial.println("-- Done");
+}
+
+void loop() {
+}
@@ -0,0 +1,38 @@
+/*
+===============================================================================================================
+QMC5883LCompass.h Library Binary Stream Example Sketch
+Learn more at [https://github.com/mprograms/QMC5883LCompass]
+
+This example sends every raw sample at the full 200Hz data rate over the serial port as compact binary
+frames, e.g. to collect data for an offline calibration. The serial monitor only shows garbage, capture the
+port on your computer with the decoder instead:
+
+  python3 extras/stream/qmc5883l_stream.py --port /dev/ttyUSB0 --baud 115200 > samples.csv
+
+A frame of 16 samples takes about 70 bytes, so 200Hz takes about 900 bytes per second. Writing never blocks:
+when the port falls behind, whole frames are dropped and the decoder reports them as lost.
+
+===============================================================================================================
+Release under the GNU General Public License v3
+[https://www.gnu.org/licenses/gpl-3.0.en.html]
+===============================================================================================================
+*/
+#include <QMC5883LCompass.h>
+#include <QMC5883LStream.h>
+
+QMC5883LCompass compass;
+QMC5883LStream stream;
+
+void setup() {
+  Serial.begin(115200);
+  compass.init();
+  compass.setMode(0x01, 0x0C, 0x10, 0x00);
+  stream.begin(Serial);
+}
+
+void loop() {
+  QMC5883LSample sample;
+  if ( compass.readBurst(&sample, 1) ) {
+    stream.add(compass, sample);
+  }
+}
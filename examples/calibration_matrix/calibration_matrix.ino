@@ -0,0 +1,84 @@
+/*
+QMC5883LCompass.h Library Calibration Matrix Example Sketch
+Learn more at [https://github.com/mprograms/QMC5883LCompass]
+
+Upload this sketch onto your Arduino to fit a full soft-iron calibration for your QMC5883L chip. Use it
+instead of the calibration sketch when the sensor is mounted close to motors or other iron, which
+distort the readings across axes.
+After upload, run the serial monitor and follow the directions.
+When prompted, copy the lines into your project's actual sketch.
+
+===============================================================================================================
+Release under the GNU General Public License v3
+[https://www.gnu.org/licenses/gpl-3.0.en.html]
+===============================================================================================================
+
+
+
+
+
+
+
+
+
+
+
+                                          UTILITY SKETCH
+                                    NO SERVICABLE PARTS BELOW
+
+*/
+#include <QMC5883LCompass.h>
+
+#define SAMPLES 64
+
+QMC5883LCompass compass;
+int16_t samples[SAMPLES][3];
+
+void setup() {
+  Serial.begin(9600);
+  compass.init();
+  compass.clearCalibration();
+
+  Serial.println("This will provide calibration settings for your QMC5883L chip. When prompted, move the magnetometer in all directions until the calibration is complete.");
+  Serial.println("Calibration will begin in 5 seconds.");
+  delay(5000);
+
+  Serial.println("CALIBRATING. Keep moving your sensor...");
+  for (int i = 0; i < SAMPLES; i++) {
+    compass.read();
+    samples[i][0] = compass.getX();
+    samples[i][1] = compass.getY();
+    samples[i][2] = compass.getZ();
+    delay(150);
+  }
+
+  if (!compass.fitCalibrationMatrix(samples, SAMPLES)) {
+    Serial.println("FAILED. The readings don't cover enough directions, reset to try again.");
+    return;
+  }
+
+  Serial.println("DONE. Copy the lines below and paste it into your projects sketch.");
+  Serial.println();
+  Serial.print("compass.setCalibrationOffsets(");
+  Serial.print(compass.getCalibrationOffset(0));
+  Serial.print(", ");
+  Serial.print(compass.getCalibrationOffset(1));
+  Serial.print(", ");
+  Serial.print(compass.getCalibrationOffset(2));
+  Serial.println(");");
+  Serial.print("const float matrix[3][3] = {");
+  for (int r = 0; r < 3; r++) {
+    Serial.print("{");
+    for (int c = 0; c < 3; c++) {
+      Serial.print(compass.getCalibrationMatrix(r, c), 4);
+      if (c < 2) Serial.print(", ");
+    }
+    Serial.print(r < 2 ? "}, " : "}");
+  }
+  Serial.println("};");
+  Serial.println("compass.setCalibrationMatrix(matrix);");
+}
+
+void loop() {
+  delay(1000);
+}
@@ -22,7 +22,7 @@ void setup() {
 void loop() {
   compass.read();
   
-  byte a = compass.getAzimuth();
+  int a = compass.getAzimuth();
 
   char myArray[3];
   compass.getDirection(myArray, a);
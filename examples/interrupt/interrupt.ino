@@ -0,0 +1,55 @@
+/*
+===============================================================================================================
+QMC5883LCompass.h Library Interrupt Example Sketch
+Learn more at [https://github.com/mprograms/QMC5883LCompass]
+
+This example shows how to use the DRDY pin of the chip to collect samples without polling.
+Connect the DRDY pin of your board to an interrupt capable pin (pin 2 on an Uno / Nano).
+
+===============================================================================================================
+Release under the GNU General Public License v3
+[https://www.gnu.org/licenses/gpl-3.0.en.html]
+===============================================================================================================
+*/
+#include <QMC5883LCompass.h>
+
+QMC5883LCompass compass;
+QMC5883LSample ring[16];
+QMC5883LSample samples[8];
+
+void setup() {
+  Serial.begin(9600);
+  compass.init();
+
+  // Run the chip at 200Hz and let the DRDY pin tell us when a new sample is ready.
+  compass.setMode(0x01, 0x0C, 0x10, 0x00);
+  if ( !compass.enableInterrupt(2, ring) ) {
+    Serial.println("Pin 2 can't be used as an interrupt.");
+  }
+}
+
+void loop() {
+  // Move flagged measurements from the chip into the sample buffer.
+  compass.service();
+
+  // Drain the buffer in batches.
+  if ( compass.samplesAvailable() >= 4 ) {
+    uint8_t n = compass.readSamples(samples, 8);
+
+    for ( uint8_t i = 0; i < n; i++ ) {
+      Serial.print("T: ");
+      Serial.print(samples[i].t);
+      Serial.print(" X: ");
+      Serial.print(samples[i].x);
+      Serial.print(" Y: ");
+      Serial.print(samples[i].y);
+      Serial.print(" Z: ");
+      Serial.print(samples[i].z);
+      Serial.println();
+    }
+
+    Serial.print("A: ");
+    Serial.print(compass.getAzimuth());
+    Serial.println();
+  }
+}
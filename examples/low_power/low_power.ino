@@ -0,0 +1,38 @@
+/*
+===============================================================================================================
+QMC5883LCompass.h Library Low Power Example Sketch
+Learn more at [https://github.com/mprograms/QMC5883LCompass]
+
+The compass is kept in standby and only woken up for a reading every 5 seconds. Each reading averages 4
+measurements. Replace the delay with your board's sleep function to save power on the MCU as well.
+
+===============================================================================================================
+Release under the GNU General Public License v3
+[https://www.gnu.org/licenses/gpl-3.0.en.html]
+===============================================================================================================
+*/
+#include <QMC5883LCompass.h>
+
+QMC5883LCompass compass;
+
+void setup() {
+  Serial.begin(9600);
+  compass.init();
+  compass.standby();
+
+  // init() sets 200Hz and OSR 512.
+  Serial.print("Each reading takes about ");
+  Serial.print(QMC5883LCompass::estimateReadTime(0x0C, 4));
+  Serial.print(" ms and ");
+  Serial.print(QMC5883LCompass::estimateEnergy(0x00, 4) / 1000);
+  Serial.println(" uJ.");
+}
+
+void loop() {
+  if ( compass.readOnce(4) & QMC5883L_STATUS_DRDY ) {
+    Serial.print("A: ");
+    Serial.println(compass.getAzimuth());
+  }
+
+  delay(5000);
+}
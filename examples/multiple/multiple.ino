@@ -0,0 +1,45 @@
+/*
+===============================================================================================================
+QMC5883LCompass.h Library Multiple Compass Example Sketch
+Learn more at [https://github.com/mprograms/QMC5883LCompass]
+
+This example shows how to run several compasses from one sketch. The QMC5883L has a fixed I2C
+address, so each chip needs its own I2C bus or its own channel on a TCA9548A multiplexer.
+
+===============================================================================================================
+Release under the GNU General Public License v3
+[https://www.gnu.org/licenses/gpl-3.0.en.html]
+===============================================================================================================
+*/
+#include <QMC5883LCompass.h>
+
+QMC5883LCompass compassA;
+QMC5883LCompass compassB;
+QMC5883LCompass* compasses[] = { &compassA, &compassB };
+
+void setup() {
+  Serial.begin(9600);
+
+  // Both chips sit behind a TCA9548A at address 0x70, on channels 0 and 1.
+  compassA.setMux(0x70, 0);
+  compassB.setMux(0x70, 1);
+
+  compassA.begin(Wire, 0x0D);
+  compassB.begin(Wire, 0x0D);
+
+  // On boards with a second I2C controller you can use that instead of a multiplexer:
+  // compassB.begin(Wire1, 0x0D);
+}
+
+void loop() {
+  // Read every compass back-to-back.
+  QMC5883LCompass::readAll(compasses, 2);
+
+  Serial.print("A: ");
+  Serial.print(compassA.getAzimuth());
+  Serial.print(" B: ");
+  Serial.print(compassB.getAzimuth());
+  Serial.println();
+
+  delay(250);
+}
@@ -0,0 +1,52 @@
+/*
+===============================================================================================================
+QMC5883LCompass.h Library Orientation Example Sketch
+Learn more at [https://github.com/mprograms/QMC5883LCompass]
+
+This example fuses the compass with a gyroscope and an accelerometer into a tilt compensated heading that
+follows fast turns without lag. The filter runs once per compass sample at 100Hz.
+
+Fill in readImu() for your IMU. Its axes must match the compass axes: a level sensor at rest reads
+(0, 0, +1g) on the accelerometer, and turning it clockwise seen from above reads a negative Z rate.
+On boards without an FPU, use QMC5883LMahonyFixed and pass QMC5883LQ16 values instead.
+
+===============================================================================================================
+Release under the GNU General Public License v3
+[https://www.gnu.org/licenses/gpl-3.0.en.html]
+===============================================================================================================
+*/
+#include <QMC5883LCompass.h>
+#include <QMC5883LMahony.h>
+
+QMC5883LCompass compass;
+QMC5883LMahonyFloat fusion;
+
+// Gyroscope in rad/s, accelerometer in any unit.
+void readImu(float& gx, float& gy, float& gz, float& ax, float& ay, float& az) {
+  gx = 0;
+  gy = 0;
+  gz = 0;
+  ax = 0;
+  ay = 0;
+  az = 1;
+}
+
+void setup() {
+  Serial.begin(9600);
+  compass.init();
+  compass.setMode(0x01, 0x08, 0x10, 0x00);
+
+  // Take the step size from the 100Hz data rate.
+  fusion.begin(compass);
+}
+
+void loop() {
+  if ( compass.readIfReady() ) {
+    float gx, gy, gz, ax, ay, az;
+    readImu(gx, gy, gz, ax, ay, az);
+    fusion.update(gx, gy, gz, ax, ay, az);
+
+    Serial.print("Heading: ");
+    Serial.println(fusion.getHeading());
+  }
+}
@@ -0,0 +1,88 @@
+/*
+QMC5883LCompass.h Library Save Calibration Example Sketch
+Learn more at [https://github.com/mprograms/QMC5883LCompass]
+
+Restores the calibration saved by a previous run, so the compass is ready right after power-on. If nothing
+valid is stored yet, runs a calibration and saves it. Uses Preferences on ESP32 and EEPROM everywhere else.
+ESP8266 and RP2040 boards emulate the EEPROM in flash: it has to be sized with EEPROM.begin() and written
+back with EEPROM.commit(), which the sketch does on those boards.
+Send any character over the serial monitor to calibrate again.
+
+===============================================================================================================
+Release under the GNU General Public License v3
+[https://www.gnu.org/licenses/gpl-3.0.en.html]
+===============================================================================================================
+*/
+#include <QMC5883LCompass.h>
+#if defined(ESP32)
+#include <Preferences.h>
+Preferences preferences;
+#else
+#include <EEPROM.h>
+#define EEPROM_ADDRESS 0
+#if defined(ESP8266) || defined(ARDUINO_ARCH_RP2040)
+#define EEPROM_EMULATED
+#endif
+#endif
+
+QMC5883LCompass compass;
+
+bool load() {
+  uint8_t data[QMC5883L_CALIBRATION_SIZE];
+#if defined(ESP32)
+  preferences.getBytes("calibration", data, sizeof(data));
+#else
+  EEPROM.get(EEPROM_ADDRESS, data);
+#endif
+  return compass.loadCalibration(data, sizeof(data));
+}
+
+void save() {
+  uint8_t data[QMC5883L_CALIBRATION_SIZE];
+  compass.saveCalibration(data, sizeof(data));
+#if defined(ESP32)
+  preferences.putBytes("calibration", data, sizeof(data));
+#else
+  EEPROM.put(EEPROM_ADDRESS, data);
+#if defined(EEPROM_EMULATED)
+  EEPROM.commit();
+#endif
+#endif
+}
+
+void calibrate() {
+  Serial.println("CALIBRATING. Keep moving your sensor...");
+  compass.calibrate();
+  save();
+  Serial.println("DONE. Calibration saved.");
+}
+
+void setup() {
+  Serial.begin(9600);
+#if defined(ESP32)
+  preferences.begin("compass");
+#elif defined(EEPROM_EMULATED)
+  EEPROM.begin(EEPROM_ADDRESS + QMC5883L_CALIBRATION_SIZE);
+#endif
+  compass.init();
+
+  // Load after init(), the saved offsets are converted for the range it sets.
+  if ( load() ) {
+    Serial.println("Calibration restored.");
+  } else {
+    Serial.println("No calibration stored.");
+    calibrate();
+  }
+}
+
+void loop() {
+  if ( Serial.available() ) {
+    while ( Serial.available() ) Serial.read();
+    calibrate();
+  }
+
+  compass.read();
+  Serial.print("A: ");
+  Serial.println(compass.getAzimuth());
+  delay(250);
+}
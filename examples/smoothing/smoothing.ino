@@ -22,7 +22,7 @@ void setup() {
    *   call setSmoothing(STEPS, ADVANCED);
    *   
    *   STEPS     = int   The number of steps to smooth the results by. Valid 1 to 10.
-   *                     Higher steps equals more smoothing but longer process time.
+   *                     Higher steps equals more smoothing.
    *                     
    *   ADVANCED  = bool  Turn advanced smmothing on or off. True will remove the max and min values from each step and then process as normal.
    *                     Turning this feature on will results in even more smoothing but will take longer to process.
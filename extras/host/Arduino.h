@@ -0,0 +1,98 @@
+/*
+===============================================================================================================
+QMC5883LCompass host backend - Arduino.h
+Just enough of the Arduino core to build the library on a desktop computer.
+
+Time is virtual: micros() and millis() only move when the I2C bus, Serial, delay() or yield() advance the clock
+(see hostAdvance()). Runs are repeatable and a simulated second takes as long as the code needs, not a second.
+===============================================================================================================
+*/
+#ifndef QMC5883L_HOST_ARDUINO_H
+#define QMC5883L_HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdio.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define PROGMEM
+#define pgm_read_byte(addr) (*(const uint8_t*)(addr))
+#define pgm_read_word(addr) (*(const uint16_t*)(addr))
+
+#define LOW 0
+#define HIGH 1
+#define INPUT 0
+#define OUTPUT 1
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+#define NOT_AN_INTERRUPT -1
+
+#define PI 3.1415926535897932384626433832795
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+// Virtual clock
+uint64_t hostMicros();
+void hostAdvance(uint32_t us);
+void hostOnAdvance(void (*fn)(void* ctx), void* ctx);
+
+unsigned long micros();
+unsigned long millis();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+// Pins and interrupts. A simulated device can drive a pin with hostSetPin(), which also fires an
+// attached interrupt handler on the matching edge.
+void pinMode(uint8_t pin, uint8_t mode);
+int digitalRead(uint8_t pin);
+int digitalPinToInterrupt(uint8_t pin);
+void attachInterrupt(int irq, void (*handler)(), int mode);
+void detachInterrupt(int irq);
+void noInterrupts();
+void interrupts();
+void hostSetPin(uint8_t pin, int level);
+
+class Print {
+  public:
+	virtual ~Print() {}
+	virtual size_t write(uint8_t value) = 0;
+	virtual size_t write(const uint8_t* data, size_t length);
+	virtual int availableForWrite() { return 0; }
+};
+
+class Stream : public Print {
+  public:
+	virtual int available() = 0;
+	virtual int read() = 0;
+	virtual int peek() = 0;
+};
+
+// Serial port that sends to a file at the set baud rate. Like on a board, bytes go into a 64 byte transmit
+// buffer and write() waits for room once it is full. Nothing is ever received.
+class HostSerial : public Stream {
+  public:
+	void begin(unsigned long baud);
+	void setOutput(FILE* file);
+	size_t write(uint8_t value) override;
+	using Print::write;
+	int availableForWrite() override;
+	int available() override { return 0; }
+	int read() override { return -1; }
+	int peek() override { return -1; }
+	
+  private:
+	uint32_t _byteTime = 1042;
+	uint64_t _busyUntil = 0;
+	FILE* _file = nullptr;
+};
+
+extern HostSerial Serial;
+
+#endif
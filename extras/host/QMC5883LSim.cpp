@@ -0,0 +1,231 @@
+/*
+===============================================================================================================
+QMC5883LCompass host backend - simulated QMC5883L
+===============================================================================================================
+*/
+#include "QMC5883LSim.h"
+
+// Output data rates 10, 50, 100 and 200 Hz as conversion periods in us.
+static const uint32_t _periods[4] = {100000, 20000, 10000, 5000};
+
+
+QMC5883LSim::QMC5883LSim() {
+	memset(_reg, 0, sizeof(_reg));
+	_reg[0x0D] = 0xFF;
+}
+
+QMC5883LSim::~QMC5883LSim() {
+	if ( _replay ) {
+		fclose(_replay);
+	}
+}
+
+
+/**
+	ATTACH
+	Put the chip on a bus. The DRDY pin is driven high while a measurement waits to be read,
+	if the interrupt pin is enabled (INT_ENB cleared).
+**/
+void QMC5883LSim::attach(TwoWire& wire, uint8_t address, uint8_t intPin) {
+	wire.attach(address, this);
+	_intPin = intPin;
+	hostOnAdvance(_onAdvance, this);
+}
+
+
+/**
+	SOURCES
+**/
+void QMC5883LSim::setField(const QMC5883LSimField& field) {
+	_field = field;
+	_heading = field.heading;
+}
+
+// One sample per line: x,y,z in raw counts and optionally the raw temperature. Lines starting
+// with # are skipped.
+bool QMC5883LSim::replay(const char* path, bool loop) {
+	if ( _replay ) {
+		fclose(_replay);
+	}
+	_replay = fopen(path, "r");
+	_replayLoop = loop;
+	return _replay != nullptr;
+}
+
+// Put raw values in the data registers as if a conversion had just finished.
+void QMC5883LSim::load(int16_t x, int16_t y, int16_t z, uint8_t status) {
+	int16_t v[3] = {x, y, z};
+	for ( int i = 0; i < 3; i++ ) {
+		_reg[i * 2] = v[i] & 0xFF;
+		_reg[i * 2 + 1] = (v[i] >> 8) & 0xFF;
+	}
+	_reg[0x07] = _temperature & 0xFF;
+	_reg[0x08] = (_temperature >> 8) & 0xFF;
+	_reg[0x06] = status;
+	_setDrdy(status & 0x01);
+}
+
+void QMC5883LSim::setTemperature(int16_t raw) {
+	_temperature = raw;
+}
+
+// True heading of the synthetic sensor at the last conversion, in degrees.
+float QMC5883LSim::getHeading() {
+	float h = fmodf(_heading, 360);
+	return h < 0 ? h + 360 : h;
+}
+
+uint32_t QMC5883LSim::getConversions() {
+	return _conversions;
+}
+
+
+/**
+	I2C
+	The first byte of a write sets the register pointer, the rest are written from there.
+	Reads auto increment the pointer; with roll-over (ROL_PNT) it wraps from 0x06 back to 0x00.
+**/
+void QMC5883LSim::write(const uint8_t* data, size_t length) {
+	if ( !length ) {
+		return;
+	}
+	_update();
+	_pointer = data[0];
+	for ( size_t i = 1; i < length; i++, _pointer++ ) {
+		if ( _pointer == 0x0A && (data[i] & 0x80) ) {
+			// Soft reset: all registers back to their defaults, standby.
+			memset(_reg, 0, sizeof(_reg));
+			_reg[0x0D] = 0xFF;
+			_setDrdy(false);
+			continue;
+		}
+		if ( _pointer >= 0x09 && _pointer <= 0x0B ) {
+			bool start = _pointer == 0x09 && (_reg[0x09] & 0x03) != 0x01 && (data[i] & 0x03) == 0x01;
+			_reg[_pointer] = data[i];
+			if ( start ) {
+				_lastConversion = hostMicros();
+			}
+		}
+	}
+}
+
+size_t QMC5883LSim::read(uint8_t* data, size_t length) {
+	_update();
+	for ( size_t i = 0; i < length; i++ ) {
+		uint8_t p = _pointer;
+		data[i] = p < sizeof(_reg) ? _reg[p] : 0;
+		if ( p < 0x06 ) {
+			// Reading the data registers clears DRDY and DOR.
+			_reg[0x06] &= ~0x05;
+			_setDrdy(false);
+		}
+		_pointer = ( (_reg[0x0A] & 0x40) && p == 0x06 ) ? 0x00 : p + 1;
+	}
+	return length;
+}
+
+
+/**
+	CONVERSIONS
+	Catch up with the virtual clock, one conversion per ODR period in continuous mode.
+**/
+void QMC5883LSim::_onAdvance(void* ctx) {
+	((QMC5883LSim*)ctx)->_update();
+}
+
+uint32_t QMC5883LSim::_period() {
+	return _periods[(_reg[0x09] >> 2) & 0x03];
+}
+
+void QMC5883LSim::_update() {
+	if ( (_reg[0x09] & 0x03) != 0x01 ) {
+		return;
+	}
+	uint64_t now = hostMicros();
+	while ( now - _lastConversion >= _period() ) {
+		_lastConversion += _period();
+		_convert();
+	}
+}
+
+void QMC5883LSim::_convert() {
+	float mg[3];
+	if ( !_nextField(mg) ) {
+		return;
+	}
+	_conversions++;
+	
+	// 12000 LSB / G at 2G, 3000 LSB / G at 8G. Out of range measurements read as 0 with OVL set.
+	float lsb = (_reg[0x09] & 0x30) ? 3 : 12;
+	bool overflow = false;
+	int16_t v[3];
+	for ( int i = 0; i < 3; i++ ) {
+		long raw = lroundf(mg[i] * lsb);
+		if ( raw > 32767 || raw < -32768 ) {
+			overflow = true;
+		}
+		v[i] = (int16_t)constrain(raw, -32768L, 32767L);
+	}
+	if ( overflow ) {
+		v[0] = v[1] = v[2] = 0;
+	}
+	
+	bool unread = _reg[0x06] & 0x01;
+	load(v[0], v[1], v[2], 0x01 | (overflow ? 0x02 : 0) | ((unread || (_reg[0x06] & 0x04)) ? 0x04 : 0));
+}
+
+bool QMC5883LSim::_nextField(float mg[3]) {
+	if ( _replay ) {
+		char line[128];
+		for ( int tries = 0; tries < 2; tries++ ) {
+			while ( fgets(line, sizeof(line), _replay) ) {
+				long x, y, z, t;
+				int n = sscanf(line, "%ld,%ld,%ld,%ld", &x, &y, &z, &t);
+				if ( line[0] == '#' || n < 3 ) {
+					continue;
+				}
+				if ( n == 4 ) {
+					_temperature = (int16_t)t;
+				}
+				// Recorded values are raw counts at the current range.
+				float lsb = (_reg[0x09] & 0x30) ? 3 : 12;
+				mg[0] = x / lsb;
+				mg[1] = y / lsb;
+				mg[2] = z / lsb;
+				return true;
+			}
+			if ( !_replayLoop ) {
+				return false;
+			}
+			rewind(_replay);
+		}
+		return false;
+	}
+	
+	_heading = _field.heading + _field.rate * (float)(_lastConversion / 1e6);
+	float a = _heading * (float)M_PI / 180;
+	float earth[3] = {_field.horizontal * cosf(a), _field.horizontal * sinf(a), _field.vertical};
+	for ( int i = 0; i < 3; i++ ) {
+		mg[i] = _field.offset[i] + _field.noise * _gauss();
+		for ( int j = 0; j < 3; j++ ) {
+			mg[i] += _field.matrix[i][j] * earth[j];
+		}
+	}
+	return true;
+}
+
+// Box-Muller on a small LCG, so runs are repeatable.
+float QMC5883LSim::_gauss() {
+	float u[2];
+	for ( int i = 0; i < 2; i++ ) {
+		_seed = _seed * 1103515245 + 12345;
+		u[i] = ((_seed >> 8) + 1.0f) / 16777217.0f;
+	}
+	return sqrtf(-2 * logf(u[0])) * cosf(2 * (float)M_PI * u[1]);
+}
+
+void QMC5883LSim::_setDrdy(bool on) {
+	if ( _intPin != 0xFF ) {
+		hostSetPin(_intPin, (on && !(_reg[0x0A] & 0x01)) ? HIGH : LOW);
+	}
+}
@@ -0,0 +1,80 @@
+/*
+===============================================================================================================
+QMC5883LCompass host backend - simulated QMC5883L
+Register level model of the chip for the host Wire bus: continuous mode at the set ODR, DRDY / OVL / DOR,
+pointer roll-over, the temperature registers, soft reset and the DRDY pin.
+
+The field comes from a source: a synthetic sensor turning on the spot (hard / soft iron and noise added), a
+recorded CSV file, or raw register values loaded with load() (for fuzzing the unpacking code).
+===============================================================================================================
+*/
+#ifndef QMC5883L_SIM_H
+#define QMC5883L_SIM_H
+
+#include "Arduino.h"
+#include "Wire.h"
+#include <stdio.h>
+
+/**
+	SYNTHETIC FIELD
+	A sensor held flat and turning at a steady rate. Fields in milligauss.
+	
+	horizontal	Horizontal component of the earth field.
+	vertical	Vertical component of the earth field.
+	heading		Heading at t = 0, in degrees.
+	rate		Turn rate in degrees per second.
+	offset		Hard iron offset.
+	matrix		Soft iron distortion, applied before the offset.
+	noise		Standard deviation of the noise added to each axis.
+**/
+struct QMC5883LSimField {
+	float horizontal = 200;
+	float vertical = 400;
+	float heading = 0;
+	float rate = 36;
+	float offset[3] = {0, 0, 0};
+	float matrix[3][3] = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+	float noise = 0;
+};
+
+class QMC5883LSim : public HostI2CDevice {
+  public:
+	QMC5883LSim();
+	~QMC5883LSim();
+	void attach(TwoWire& wire, uint8_t address = 0x0D, uint8_t intPin = 0xFF);
+	
+	void setField(const QMC5883LSimField& field);
+	bool replay(const char* path, bool loop = true);
+	void load(int16_t x, int16_t y, int16_t z, uint8_t status = 0x01);
+	void setTemperature(int16_t raw);
+	
+	float getHeading();
+	uint32_t getConversions();
+	
+	void write(const uint8_t* data, size_t length) override;
+	size_t read(uint8_t* data, size_t length) override;
+	
+  private:
+	static void _onAdvance(void* ctx);
+	void _update();
+	void _convert();
+	bool _nextField(float mg[3]);
+	uint32_t _period();
+	float _gauss();
+	void _setDrdy(bool on);
+	
+	uint8_t _reg[14];
+	uint8_t _pointer = 0;
+	uint8_t _intPin = 0xFF;
+	uint64_t _lastConversion = 0;
+	uint32_t _conversions = 0;
+	int16_t _temperature = 2500;
+	
+	QMC5883LSimField _field;
+	float _heading = 0;
+	FILE* _replay = nullptr;
+	bool _replayLoop = true;
+	uint32_t _seed = 12345;
+};
+
+#endif
@@ -0,0 +1,64 @@
+/*
+===============================================================================================================
+QMC5883LCompass host backend - Wire.h
+An I2C bus with simulated devices instead of hardware. Devices are attached to an address with
+TwoWire::attach(). Every transaction advances the virtual clock by the time it would take on the bus at the
+clock set with setClock().
+===============================================================================================================
+*/
+#ifndef QMC5883L_HOST_WIRE_H
+#define QMC5883L_HOST_WIRE_H
+
+#include "Arduino.h"
+
+/**
+	I2C DEVICE
+	A simulated device on the bus.
+	
+	write()	Bytes of a write transaction, the first one is usually the register pointer.
+	read()	Fill a read transaction, return the number of bytes the device sent.
+**/
+class HostI2CDevice {
+  public:
+	virtual ~HostI2CDevice() {}
+	virtual void write(const uint8_t* data, size_t length) = 0;
+	virtual size_t read(uint8_t* data, size_t length) = 0;
+};
+
+class TwoWire {
+  public:
+	void begin();
+	void setClock(uint32_t hz);
+	void attach(uint8_t address, HostI2CDevice* device);
+	
+	void beginTransmission(uint8_t address);
+	size_t write(uint8_t value);
+	uint8_t endTransmission(bool stop = true);
+	uint8_t requestFrom(uint8_t address, uint8_t length, uint8_t stop = true);
+	uint8_t requestFrom(int address, int length);
+	int available();
+	int read();
+	
+	// Let the next count transactions fail, to test error handling.
+	uint16_t failNext = 0;
+	// Number of transactions so far.
+	uint32_t transactions = 0;
+	
+  private:
+	HostI2CDevice* _find(uint8_t address);
+	void _busTime(size_t bytes);
+	
+	uint32_t _clock = 100000;
+	HostI2CDevice* _devices[8] = {};
+	uint8_t _addresses[8] = {};
+	uint8_t _txAddress = 0;
+	uint8_t _tx[32];
+	size_t _txLength = 0;
+	uint8_t _rx[32];
+	size_t _rxLength = 0;
+	size_t _rxPos = 0;
+};
+
+extern TwoWire Wire;
+
+#endif
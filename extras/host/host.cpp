@@ -0,0 +1,249 @@
+/*
+===============================================================================================================
+QMC5883LCompass host backend - virtual clock, pins and I2C bus.
+===============================================================================================================
+*/
+#include "Arduino.h"
+#include "Wire.h"
+
+static uint64_t _now = 0;
+static void (*_advanceFn[4])(void*) = {};
+static void* _advanceCtx[4] = {};
+
+static int _pins[64] = {};
+static void (*_handlers[64])() = {};
+static int _handlerModes[64] = {};
+static bool _interruptsOn = true;
+
+TwoWire Wire;
+HostSerial Serial;
+
+
+/**
+	VIRTUAL CLOCK
+	Move time forward. Devices registered with hostOnAdvance() catch up on every step.
+**/
+uint64_t hostMicros() {
+	return _now;
+}
+
+void hostAdvance(uint32_t us) {
+	_now += us;
+	for ( int i = 0; i < 4; i++ ) {
+		if ( _advanceFn[i] ) {
+			_advanceFn[i](_advanceCtx[i]);
+		}
+	}
+}
+
+void hostOnAdvance(void (*fn)(void* ctx), void* ctx) {
+	for ( int i = 0; i < 4; i++ ) {
+		if ( !_advanceFn[i] ) {
+			_advanceFn[i] = fn;
+			_advanceCtx[i] = ctx;
+			return;
+		}
+	}
+}
+
+unsigned long micros() {
+	return (unsigned long)(uint32_t)_now;
+}
+
+unsigned long millis() {
+	return (unsigned long)(uint32_t)(_now / 1000);
+}
+
+void delay(unsigned long ms) {
+	hostAdvance(ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us) {
+	hostAdvance(us);
+}
+
+// A busy loop on a real board takes a few us per round.
+void yield() {
+	hostAdvance(2);
+}
+
+
+/**
+	PINS AND INTERRUPTS
+**/
+void pinMode(uint8_t, uint8_t) {
+}
+
+int digitalRead(uint8_t pin) {
+	return _pins[pin & 63];
+}
+
+int digitalPinToInterrupt(uint8_t pin) {
+	return pin < 64 ? pin : NOT_AN_INTERRUPT;
+}
+
+void attachInterrupt(int irq, void (*handler)(), int mode) {
+	_handlers[irq & 63] = handler;
+	_handlerModes[irq & 63] = mode;
+}
+
+void detachInterrupt(int irq) {
+	_handlers[irq & 63] = nullptr;
+}
+
+void noInterrupts() {
+	_interruptsOn = false;
+}
+
+void interrupts() {
+	_interruptsOn = true;
+}
+
+void hostSetPin(uint8_t pin, int level) {
+	pin &= 63;
+	int old = _pins[pin];
+	_pins[pin] = level;
+	if ( old == level || !_handlers[pin] || !_interruptsOn ) {
+		return;
+	}
+	int mode = _handlerModes[pin];
+	if ( mode == CHANGE || (mode == RISING && level) || (mode == FALLING && !level) ) {
+		_handlers[pin]();
+	}
+}
+
+
+/**
+	SERIAL
+	10 bits per byte. The transmit buffer holds the bytes that are not on the wire yet.
+**/
+size_t Print::write(const uint8_t* data, size_t length) {
+	size_t n = 0;
+	while ( n < length && write(data[n]) ) {
+		n++;
+	}
+	return n;
+}
+
+void HostSerial::begin(unsigned long baud) {
+	_byteTime = (uint32_t)(10000000UL / (baud ? baud : 9600));
+}
+
+void HostSerial::setOutput(FILE* file) {
+	_file = file;
+}
+
+int HostSerial::availableForWrite() {
+	uint64_t now = hostMicros();
+	uint64_t queued = ( _busyUntil > now ) ? (_busyUntil - now + _byteTime - 1) / _byteTime : 0;
+	return queued < 64 ? (int)(64 - queued) : 0;
+}
+
+size_t HostSerial::write(uint8_t value) {
+	while ( availableForWrite() == 0 ) {
+		hostAdvance(_byteTime);
+	}
+	uint64_t now = hostMicros();
+	_busyUntil = ( _busyUntil > now ? _busyUntil : now ) + _byteTime;
+	if ( _file ) {
+		fputc(value, _file);
+	}
+	return 1;
+}
+
+
+/**
+	I2C BUS
+**/
+void TwoWire::begin() {
+}
+
+void TwoWire::setClock(uint32_t hz) {
+	_clock = hz ? hz : 100000;
+}
+
+void TwoWire::attach(uint8_t address, HostI2CDevice* device) {
+	for ( int i = 0; i < 8; i++ ) {
+		if ( !_devices[i] || _addresses[i] == address ) {
+			_devices[i] = device;
+			_addresses[i] = address;
+			return;
+		}
+	}
+}
+
+HostI2CDevice* TwoWire::_find(uint8_t address) {
+	for ( int i = 0; i < 8 && _devices[i]; i++ ) {
+		if ( _addresses[i] == address ) {
+			return _devices[i];
+		}
+	}
+	return nullptr;
+}
+
+// Start, address byte, data bytes and stop, 9 clocks per byte.
+void TwoWire::_busTime(size_t bytes) {
+	hostAdvance((uint32_t)(((bytes + 1) * 9 + 2) * 1000000ULL / _clock));
+}
+
+void TwoWire::beginTransmission(uint8_t address) {
+	_txAddress = address;
+	_txLength = 0;
+}
+
+size_t TwoWire::write(uint8_t value) {
+	if ( _txLength >= sizeof(_tx) ) {
+		return 0;
+	}
+	_tx[_txLength++] = value;
+	return 1;
+}
+
+uint8_t TwoWire::endTransmission(bool) {
+	transactions++;
+	_busTime(_txLength);
+	HostI2CDevice* device = _find(_txAddress);
+	if ( failNext ) {
+		failNext--;
+		return 4;
+	}
+	if ( !device ) {
+		return 2;
+	}
+	device->write(_tx, _txLength);
+	return 0;
+}
+
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t length, uint8_t) {
+	transactions++;
+	_rxPos = 0;
+	_rxLength = 0;
+	HostI2CDevice* device = _find(address);
+	if ( failNext ) {
+		failNext--;
+		_busTime(0);
+		return 0;
+	}
+	if ( !device ) {
+		_busTime(0);
+		return 0;
+	}
+	if ( length > sizeof(_rx) ) {
+		length = sizeof(_rx);
+	}
+	_rxLength = device->read(_rx, length);
+	_busTime(_rxLength);
+	return _rxLength;
+}
+
+uint8_t TwoWire::requestFrom(int address, int length) {
+	return requestFrom((uint8_t)address, (uint8_t)length);
+}
+
+int TwoWire::available() {
+	return _rxLength - _rxPos;
+}
+
+int TwoWire::read() {
+	return _rxPos < _rxLength ? _rx[_rxPos++] : -1;
+}
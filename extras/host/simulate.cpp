@@ -0,0 +1,365 @@
+/*
+===============================================================================================================
+QMC5883LCompass host backend - simulate
+Runs the library on a desktop computer against the simulated chip.
+
+	qmc5883l-sim profile			Time per reading and heading error for each filter / calibration setup.
+	qmc5883l-sim replay FILE		Replay a recorded CSV (x,y,z[,temperature] raw counts), print the azimuth.
+	qmc5883l-sim fuzz [N]			Check sample unpacking, atan2 and the fixed-point calibration on N random
+								inputs. Exits with 1 on the first mismatch.
+	qmc5883l-sim check			Check the read path against the timing of the chip: status bits,
+								counters and auto range. Exits with 1 on the first failure.
+	qmc5883l-sim stream FILE [S] [BAUD]	Write S seconds of raw 200Hz samples from a turning sensor with hard
+								iron to FILE as QMC5883LStream frames, sent over a BAUD Serial port.
+
+Times are host CPU times and include the simulated bus, so only compare them with each other.
+===============================================================================================================
+*/
+#include <QMC5883LCompass.h>
+#include <QMC5883LStream.h>
+#include "QMC5883LSim.h"
+#include <chrono>
+
+static QMC5883LSim chip;
+static QMC5883LCompass compass;
+
+static uint32_t _seed = 1;
+
+static long randomRange(long lo, long hi) {
+	_seed = _seed * 1664525 + 1013904223;
+	return lo + (long)((uint64_t)_seed * (uint64_t)(hi - lo + 1) >> 32);
+}
+
+// Signed difference between two headings in degrees, -180 - 180.
+static float headingError(float a, float b) {
+	float d = fmodf(a - b + 540, 360) - 180;
+	return d;
+}
+
+
+/**
+	PROFILE
+**/
+struct Setup {
+	const char* name;
+	bool hardIron;
+	bool calibrated;
+	QMC5883LFilter filter;
+	float param;
+};
+
+static void profile() {
+	static const Setup setups[] = {
+		{"clean, raw",					false,	false,	QMC5883L_FILTER_NONE,		0},
+		{"hard iron, raw",				true,	false,	QMC5883L_FILTER_NONE,		0},
+		{"hard iron, calibrated",		true,	true,	QMC5883L_FILTER_NONE,		0},
+		{"calibrated, boxcar 5",		true,	true,	QMC5883L_FILTER_BOXCAR,		5},
+		{"calibrated, ema 3",			true,	true,	QMC5883L_FILTER_EMA,		3},
+		{"calibrated, lowpass 5 Hz",	true,	true,	QMC5883L_FILTER_LOWPASS,	5},
+		{"calibrated, median3",			true,	true,	QMC5883L_FILTER_MEDIAN3,	0},
+	};
+	const int n = 4000;
+	
+	printf("%-28s %10s %10s %10s\n", "setup", "ns/read", "mean err", "max err");
+	for ( const Setup& setup : setups ) {
+		QMC5883LSimField field;
+		field.noise = 2;
+		if ( setup.hardIron ) {
+			field.offset[0] = 120;
+			field.offset[1] = -80;
+			field.offset[2] = 40;
+		}
+		chip.setField(field);
+		compass.setReset();
+		compass.setMode(0x01, 0x0C, 0x00, 0x00);
+		compass.setFilter(setup.filter, setup.param);
+		compass.clearCalibration();
+		if ( setup.calibrated ) {
+			compass.setCalibrationOffsets(field.offset[0] * 12, field.offset[1] * 12, field.offset[2] * 12);
+		}
+		
+		double sum = 0, worst = 0;
+		std::chrono::nanoseconds spent(0);
+		for ( int i = 0; i < n; i++ ) {
+			// Wait on the virtual clock for the next measurement, then time only the read.
+			delayMicroseconds(5000);
+			auto start = std::chrono::steady_clock::now();
+			compass.read();
+			int azimuth = compass.getAzimuthCentidegrees();
+			spent += std::chrono::steady_clock::now() - start;
+			if ( i < 100 ) {
+				continue;
+			}
+			double err = fabs(headingError(azimuth / 100.0f, chip.getHeading()));
+			sum += err;
+			if ( err > worst ) {
+				worst = err;
+			}
+		}
+		printf("%-28s %10.0f %10.2f %10.2f\n", setup.name, (double)spent.count() / n, sum / (n - 100), worst);
+	}
+}
+
+
+/**
+	REPLAY
+**/
+static int replay(const char* path) {
+	if ( !chip.replay(path, false) ) {
+		fprintf(stderr, "can't open %s\n", path);
+		return 1;
+	}
+	compass.setMode(0x01, 0x0C, 0x00, 0x00);
+	uint32_t last = 0;
+	printf("t_ms,x,y,z,azimuth\n");
+	for ( ;; ) {
+		delayMicroseconds(5000);
+		if ( chip.getConversions() == last ) {
+			break;
+		}
+		last = chip.getConversions();
+		compass.read();
+		printf("%lu,%d,%d,%d,%d\n", millis(), compass.getX(), compass.getY(), compass.getZ(), compass.getAzimuth());
+	}
+	return 0;
+}
+
+
+/**
+	FUZZ
+**/
+static int fail(const char* what, long a, long b, long c) {
+	fprintf(stderr, "FAIL %s: %ld %ld %ld\n", what, a, b, c);
+	return 1;
+}
+
+static int fuzz(long n) {
+	compass.standby();
+	compass.setFilter(QMC5883L_FILTER_NONE);
+	
+	// Sample unpacking in all three streaming modes, including the int16 edge values.
+	static const int16_t edges[] = {0, 1, -1, 255, 256, -256, 32767, -32768};
+	for ( int mode = 0; mode < 3; mode++ ) {
+		compass.setStreaming(mode != 0, mode == 2);
+		compass.clearCalibration();
+		for ( long i = 0; i < n; i++ ) {
+			int16_t v[3];
+			for ( int a = 0; a < 3; a++ ) {
+				v[a] = i < 8 ? edges[(i + a) % 8] : (int16_t)randomRange(-32768, 32767);
+			}
+			int16_t t = (int16_t)randomRange(-32768, 32767);
+			chip.setTemperature(t);
+			chip.load(v[0], v[1], v[2]);
+			compass.read();
+			int16_t x, y, z;
+			compass.getXYZ(x, y, z);
+			if ( x != v[0] || y != v[1] || z != v[2] ) {
+				return fail("unpack", v[0], v[1], v[2]);
+			}
+			if ( mode == 2 && compass.getTemperature() != t ) {
+				return fail("temperature", t, compass.getTemperature(), mode);
+			}
+		}
+	}
+	compass.setStreaming(false);
+	
+	// Integer atan2 against double precision, 0.01 degree worst case.
+	for ( long i = 0; i < n; i++ ) {
+		int16_t x = (int16_t)randomRange(-32768, 32767);
+		int16_t y = (int16_t)randomRange(-32768, 32767);
+		if ( !x && !y ) {
+			continue;
+		}
+		chip.load(x, y, 0);
+		compass.read();
+		double expect = atan2((double)y, (double)x) * 18000 / M_PI;
+		if ( expect < 0 ) {
+			expect += 36000;
+		}
+		double err = fabs(headingError(compass.getAzimuthCentidegrees() / 100.0f, expect / 100));
+		if ( err > 0.011 ) {
+			return fail("atan2", x, y, compass.getAzimuthCentidegrees());
+		}
+	}
+	
+	// Fixed-point calibration against the float formula, 1 LSB.
+	for ( long i = 0; i < n; i++ ) {
+		float offset[3], scale[3];
+		for ( int a = 0; a < 3; a++ ) {
+			offset[a] = randomRange(-2000, 2000);
+			scale[a] = randomRange(500, 2000) / 1000.0f;
+		}
+		compass.setCalibrationOffsets(offset[0], offset[1], offset[2]);
+		compass.setCalibrationScales(scale[0], scale[1], scale[2]);
+		int16_t v[3];
+		for ( int a = 0; a < 3; a++ ) {
+			v[a] = (int16_t)randomRange(-8000, 8000);
+		}
+		chip.load(v[0], v[1], v[2]);
+		compass.read();
+		int got[3] = {compass.getX(), compass.getY(), compass.getZ()};
+		for ( int a = 0; a < 3; a++ ) {
+			long expect = lroundf((v[a] - offset[a]) * scale[a]);
+			if ( labs(got[a] - expect) > 1 ) {
+				return fail("calibration", v[a], expect, got[a]);
+			}
+		}
+	}
+	
+	printf("fuzz: %ld inputs per check, all passed\n", n);
+	return 0;
+}
+
+
+/**
+	CHECK
+**/
+static int check() {
+	QMC5883LSimField field;
+	chip.setField(field);
+	compass.setReset();
+	compass.setMode(0x01, 0x0C, 0x00, 0x00);
+	
+	// read() reports DOR when loop() is slower than the data rate, in every mode that reads the
+	// status before the data.
+	for ( int mode = 0; mode < 2; mode++ ) {
+		compass.setStreaming(mode == 1);
+		delay(10);
+		compass.read();
+		
+		compass.clearCounters();
+		int fresh = 0;
+		for ( int i = 0; i < 20; i++ ) {
+			delayMicroseconds(4000);
+			fresh += ( compass.read() & QMC5883L_STATUS_DRDY ) ? 1 : 0;
+		}
+		if ( fresh < 15 || fresh > 18 ) {
+			return fail("drdy", mode, fresh, 0);
+		}
+		if ( compass.getCounters().skipped != 0 ) {
+			return fail("skipped at the data rate", mode, compass.getCounters().skipped, 0);
+		}
+		
+		for ( int i = 0; i < 20; i++ ) {
+			delayMicroseconds(12500);
+			if ( !(compass.read() & QMC5883L_STATUS_DOR) ) {
+				return fail("dor", mode, i, compass.getStatus());
+			}
+		}
+		if ( compass.getCounters().skipped != 20 ) {
+			return fail("skipped below the data rate", mode, compass.getCounters().skipped, 20);
+		}
+	}
+	compass.setStreaming(false);
+	
+	// Auto range at 10 Hz with a tight read() loop: no sample measured at the old range may be
+	// published at the new one, and re-reads of one measurement don't count towards switching
+	// back to 2G.
+	field.rate = 0;
+	chip.setField(field);
+	compass.setMode(0x01, 0x00, 0x10, 0x00);
+	compass.setFilter(QMC5883L_FILTER_NONE);
+	compass.clearCalibration();
+	delay(200);
+	compass.read();
+	compass.setAutoRange(true);
+	uint32_t start = chip.getConversions();
+	for ( int i = 0; i < 2000; i++ ) {
+		delayMicroseconds(2000);
+		compass.read();
+		if ( compass.getRange() == 0x00 && chip.getConversions() - start < 16 ) {
+			return fail("range switched early", i, chip.getConversions() - start, 0);
+		}
+		if ( abs(compass.getMilliGauss(0) - 200) > 1 ) {
+			return fail("8G to 2G", i, compass.getMilliGauss(0), compass.getRange());
+		}
+	}
+	if ( compass.getRange() != 0x00 ) {
+		return fail("no switch to 2G", compass.getX(), 0, 0);
+	}
+	
+	field.horizontal = 3000;
+	chip.setField(field);
+	for ( int i = 0; i < 2000; i++ ) {
+		delayMicroseconds(2000);
+		compass.read();
+		int mg = compass.getMilliGauss(0);
+		if ( abs(mg - 200) > 1 && abs(mg - 3000) > 1 ) {
+			return fail("2G to 8G", i, mg, compass.getRange());
+		}
+	}
+	if ( compass.getRange() != 0x10 || abs(compass.getMilliGauss(0) - 3000) > 1 ) {
+		return fail("no switch to 8G", compass.getMilliGauss(0), 0, 0);
+	}
+	compass.setAutoRange(false);
+	
+	printf("check: all passed\n");
+	return 0;
+}
+
+
+/**
+	STREAM
+**/
+static int stream(const char* path, float seconds, unsigned long baud) {
+	FILE* file = fopen(path, "wb");
+	if ( !file ) {
+		fprintf(stderr, "can't open %s\n", path);
+		return 1;
+	}
+	QMC5883LSimField field;
+	field.offset[0] = 40;
+	field.offset[1] = -25;
+	field.offset[2] = 10;
+	field.noise = 2;
+	chip.setField(field);
+	compass.setMode(0x01, 0x0C, 0x00, 0x00);
+	Serial.begin(baud);
+	Serial.setOutput(file);
+	
+	static QMC5883LStream out;
+	out.begin(Serial);
+	uint32_t samples = 0;
+	uint32_t end = millis() + (uint32_t)(seconds * 1000);
+	while ( millis() < end ) {
+		QMC5883LSample s;
+		if ( compass.readBurst(&s, 1) ) {
+			out.add(compass, s);
+			samples++;
+		}
+	}
+	out.flush();
+	while ( !out.update() ) {
+		yield();
+	}
+	fclose(file);
+	fprintf(stderr, "%lu samples, %u frames, %lu dropped\n", (unsigned long)samples, out.getSequence(), (unsigned long)out.getDropped());
+	return 0;
+}
+
+
+int main(int argc, char** argv) {
+	Wire.setClock(400000);
+	chip.attach(Wire);
+	compass.init();
+	
+	const char* cmd = argc > 1 ? argv[1] : "profile";
+	if ( !strcmp(cmd, "profile") ) {
+		profile();
+		return 0;
+	}
+	if ( !strcmp(cmd, "replay") && argc > 2 ) {
+		return replay(argv[2]);
+	}
+	if ( !strcmp(cmd, "fuzz") ) {
+		return fuzz(argc > 2 ? atol(argv[2]) : 10000);
+	}
+	if ( !strcmp(cmd, "check") ) {
+		return check();
+	}
+	if ( !strcmp(cmd, "stream") && argc > 2 ) {
+		return stream(argv[2], argc > 3 ? atof(argv[3]) : 10, argc > 4 ? atol(argv[4]) : 115200);
+	}
+	fprintf(stderr, "usage: %s profile | replay FILE | fuzz [N] | check | stream FILE [S] [BAUD]\n", argv[0]);
+	return 2;
+}
@@ -0,0 +1,164 @@
+#!/usr/bin/env python3
+"""
+QMC5883LCompass binary stream decoder.
+
+Decodes the frames written by QMC5883LStream (see src/QMC5883LStream.h for the layout) from a capture
+file or a serial port and prints one sample per line as CSV. Damaged bytes are skipped up to the next
+frame with a good CRC, lost frames are reported from the gaps in the sequence numbers.
+
+    python3 qmc5883l_stream.py capture.bin > samples.csv
+    python3 qmc5883l_stream.py --port /dev/ttyUSB0 --baud 115200 > samples.csv
+    python3 qmc5883l_stream.py --replay capture.bin > recording.csv
+
+--replay writes raw samples as x,y,z lines for the replay mode of extras/host. Reading a serial port
+needs pyserial (pip install pyserial).
+
+Release under the GNU General Public License v3
+[https://www.gnu.org/licenses/gpl-3.0.en.html]
+"""
+import argparse
+import struct
+import sys
+
+SYNC = b"\xa5\x5a"
+VERSION = 1
+CALIBRATED = 0x01
+HEADER_SIZE = 14
+
+
+def crc16(data, crc=0xFFFF):
+    """CRC-16/CCITT-FALSE, same as QMC5883LCompass::crc16()."""
+    for b in data:
+        crc ^= b << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else crc << 1
+            crc &= 0xFFFF
+    return crc
+
+
+class Frame:
+    def __init__(self, sequence, flags, status, first, interval, samples):
+        self.sequence = sequence
+        self.calibrated = bool(flags & CALIBRATED)
+        self.range = 8 if flags & 0x10 else 2
+        self.status = status
+        self.first = first
+        self.interval = interval
+        # (t_us, x, y, z), t spread evenly between the first and last sample.
+        self.samples = [((first + i * interval) & 0xFFFFFFFF,) + s for i, s in enumerate(samples)]
+
+
+class Decoder:
+    """Feed bytes in any chunks, get complete frames back."""
+
+    def __init__(self):
+        self.buffer = bytearray()
+        self.frames = 0
+        self.lost = 0
+        self.errors = 0
+        self._next = None
+
+    def feed(self, data):
+        self.buffer += data
+        frames = []
+        while True:
+            start = self.buffer.find(SYNC)
+            if start < 0:
+                del self.buffer[:max(len(self.buffer) - 1, 0)]
+                return frames
+            del self.buffer[:start]
+            result = self._parse()
+            if result is None:
+                return frames
+            if result is False:
+                # Not a frame after all, look for the next sync.
+                self.errors += 1
+                del self.buffer[:1]
+                continue
+            frame, length = result
+            del self.buffer[:length]
+            if self._next is not None:
+                self.lost += (frame.sequence - self._next) & 0xFFFF
+            self._next = (frame.sequence + 1) & 0xFFFF
+            self.frames += 1
+            frames.append(frame)
+
+    def _parse(self):
+        """Frame and its length, None when more bytes are needed, False when damaged."""
+        b = self.buffer
+        if len(b) < HEADER_SIZE + 6:
+            return None
+        if b[2] != VERSION or b[6] == 0:
+            return False
+        flags = b[3]
+        sequence, count, status, first, interval = struct.unpack_from("<HBBIH", b, 4)
+        pos = HEADER_SIZE
+        sample = struct.unpack_from("<hhh", b, pos)
+        pos += 6
+        samples = [sample]
+        for _ in range(count - 1):
+            if pos >= len(b):
+                return None
+            if b[pos] == 0x80:
+                if pos + 7 > len(b):
+                    return None
+                sample = struct.unpack_from("<hhh", b, pos + 1)
+                pos += 7
+            else:
+                if pos + 3 > len(b):
+                    return None
+                d = struct.unpack_from("<bbb", b, pos)
+                sample = tuple(((v + dv + 0x8000) & 0xFFFF) - 0x8000 for v, dv in zip(sample, d))
+                pos += 3
+            samples.append(sample)
+        if pos + 2 > len(b):
+            return None
+        if struct.unpack_from("<H", b, pos)[0] != crc16(b[2:pos]):
+            return False
+        return Frame(sequence, flags, status, first, interval, samples), pos + 2
+
+
+def chunks(args):
+    if args.port:
+        import serial
+        with serial.Serial(args.port, args.baud, timeout=0.1) as port:
+            while True:
+                yield port.read(4096)
+    else:
+        with (open(args.file, "rb") if args.file != "-" else sys.stdin.buffer) as f:
+            while True:
+                data = f.read(65536)
+                if not data:
+                    return
+                yield data
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Decode QMC5883LStream frames to CSV.")
+    parser.add_argument("file", nargs="?", default="-", help="capture file, - for stdin")
+    parser.add_argument("--port", help="read from this serial port instead")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--replay", action="store_true", help="write raw x,y,z lines for extras/host replay")
+    args = parser.parse_args()
+
+    decoder = Decoder()
+    out = sys.stdout
+    if not args.replay:
+        out.write("sequence,t_us,x,y,z,status,calibrated,range\n")
+    try:
+        for data in chunks(args):
+            for frame in decoder.feed(data):
+                for t, x, y, z in frame.samples:
+                    if args.replay:
+                        if not frame.calibrated:
+                            out.write("%d,%d,%d\n" % (x, y, z))
+                    else:
+                        out.write("%d,%d,%d,%d,%d,%d,%d,%d\n" % (frame.sequence, t, x, y, z, frame.status,
+                                                                  frame.calibrated, frame.range))
+    except KeyboardInterrupt:
+        pass
+    sys.stderr.write("%d frames, %d lost, %d damaged\n" % (decoder.frames, decoder.lost, decoder.errors))
+
+
+if __name__ == "__main__":
+    main()
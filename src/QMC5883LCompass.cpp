@@ -47,6 +47,14 @@ OVER SAMPLE RATIO (OSR)
 	256         	0x40
 	128         	0x80
 	64          	0xC0 
+
+INTERRUPT PIN (INT_ENB, CONTROL REGISTER 2 0x0A)
+	Enabled     	0x00
+	Disabled    	0x01
+
+POINTER ROLL-OVER (ROL_PNT, CONTROL REGISTER 2 0x0A)
+	Normal      	0x00
+	Roll-over   	0x40	Pointer rolls over from 0x06 back to 0x00
   
 */
 
@@ -56,6 +64,49 @@ OVER SAMPLE RATIO (OSR)
 #include "QMC5883LCompass.h"
 #include <Wire.h>
 
+// ESP cores run interrupt handlers from IRAM.
+#if defined(ESP32) || defined(ESP8266)
+#define QMC5883L_ISR_ATTR IRAM_ATTR
+#else
+#define QMC5883L_ISR_ATTR
+#endif
+
+// Orders the sample ring writes before the index updates. On single core AVR a compiler
+// barrier is enough, everywhere else we need a real memory barrier.
+#if defined(__AVR__)
+#define QMC5883L_MEMORY_BARRIER() __asm__ __volatile__("" ::: "memory")
+#else
+#define QMC5883L_MEMORY_BARRIER() __sync_synchronize()
+#endif
+
+// Instrumentation probes, @see getStats(). They compile to nothing when instrumentation is off.
+#if QMC5883L_ENABLE_INSTRUMENTATION
+#define QMC5883L_PROBE_START(start) uint32_t start = micros()
+#define QMC5883L_PROBE_STOP(probe, start, ok) _probe(_stats.probe, start, ok)
+#else
+#define QMC5883L_PROBE_START(start)
+#define QMC5883L_PROBE_STOP(probe, start, ok)
+#endif
+
+// Assumptions behind estimateEnergy(). These are not measured, check them against your board.
+// The charge per oversample step is taken from about 75 uA at 10 Hz with OSR 512.
+#define QMC5883L_EST_SUPPLY_MV		3300
+#define QMC5883L_EST_NC_PER_OSR		14
+
+// Values derived from the current sample that are kept until the next one, @see getSampleId().
+#define QMC5883L_CACHE_AZIMUTH	0x01
+#define QMC5883L_CACHE_BEARING	0x02
+
+// Bump when the layout of saveCalibration() changes.
+#define QMC5883L_CALIBRATION_VERSION 2
+
+static_assert(QMC5883L_SMOOTH_MAX_STEPS >= 0 && QMC5883L_SMOOTH_MAX_STEPS <= 255,
+	"QMC5883L_SMOOTH_MAX_STEPS must be 0 - 255");
+
+#if QMC5883L_ENABLE_INTERRUPT
+QMC5883LCompass* QMC5883LCompass::_isrInstances[4] = {nullptr, nullptr, nullptr, nullptr};
+#endif
+
 QMC5883LCompass::QMC5883LCompass() {
 }
 
@@ -64,15 +115,71 @@ QMC5883LCompass::QMC5883LCompass() {
 	INIT
 	Initialize Chip - This needs to be called in the sketch setup() function.
 	
+	All control registers are written, even when the shadow copies match, since the chip may
+	have lost them in a reset or brownout.
+	
 	@since v0.1;
 **/
 void QMC5883LCompass::init(){
-	Wire.begin();
-	_writeReg(0x0B,0x01);
+	MuxScope scope(*this);
+	_wire->begin();
+	_shadowValid = 0;
+	_updateReg(0x0B,0x01);
+	_updateReg(0x0A,_ctrl2);
 	setMode(0x01,0x0C,0x10,0X00);
 }
 
 
+/**
+	BEGIN
+	Initialize the chip on the given I2C bus and address. Use this instead of init() to
+	run the compass on a second I2C controller, or to run several compasses from one sketch.
+	
+	@since v1.3.0
+**/
+void QMC5883LCompass::begin(TwoWire& wire, byte addr){
+	_wire = &wire;
+	_ADDR = addr;
+	init();
+}
+
+
+/**
+	SET MULTIPLEXER
+	Put the chip behind a TCA9548A style I2C multiplexer. The given channel is selected
+	before every transaction with the chip. Call this before init() / begin().
+	
+	Since the QMC5883L has a fixed address, a multiplexer is the way to run several chips
+	on one bus.
+	
+	@since v1.3.0
+**/
+void QMC5883LCompass::setMux(byte muxAddr, byte channel){
+	_muxSelected = false;
+	_muxAddr = muxAddr;
+	_muxChannel = channel & 0x07;
+}
+
+
+/**
+	SELECT
+	Select the multiplexer channel of the chip if one is used.
+	
+	Calls that talk to the chip several times (init(), readIfReady(), readBurst() etc.) hold a
+	MuxScope, so the channel is only selected for their first transaction. Between calls it is
+	always selected again, other code may have switched the multiplexer.
+	
+	@since v1.3.0
+**/
+void QMC5883LCompass::_select(){
+	if ( _muxAddr && !_muxSelected ) {
+		_wire->beginTransmission(_muxAddr);
+		_wire->write(1 << _muxChannel);
+		_muxSelected = ( _wire->endTransmission() == 0 && _muxHold );
+	}
+}
+
+
 /**
 	SET ADDRESS
 	Set the I2C Address of the chip. This needs to be called in the sketch setup() function.
@@ -92,335 +199,2692 @@ void QMC5883LCompass::setADDR(byte b){
 	Write the register to the chip.
 	
 	@since v0.1;
+	@return bool false if the chip did not answer
 **/
 // Write register values to chip
-void QMC5883LCompass::_writeReg(byte r, byte v){
-	Wire.beginTransmission(_ADDR);
-	Wire.write(r);
-	Wire.write(v);
-	Wire.endTransmission();
+bool QMC5883LCompass::_writeReg(byte r, byte v){
+	_pointerParked = false;
+	_select();
+	_wire->beginTransmission(_ADDR);
+	_wire->write(r);
+	_wire->write(v);
+	if ( _wire->endTransmission() ) {
+		_counters.i2cErrors++;
+		return false;
+	}
+	return true;
 }
 
 
 /**
-	CHIP MODE
-	Set the chip mode.
+	READ REGISTER
+	Read a single register from the chip.
 	
-	@since v0.1;
+	@since v1.3.0
+	@return byte register value, 0 if the chip did not answer
 **/
-// Set chip mode
-void QMC5883LCompass::setMode(byte mode, byte odr, byte rng, byte osr){
-	_writeReg(0x09,mode|odr|rng|osr);
+byte QMC5883LCompass::_readReg(byte r){
+	_pointerParked = false;
+	_select();
+	_wire->beginTransmission(_ADDR);
+	_wire->write(r);
+	if ( _wire->endTransmission() || _wire->requestFrom(_ADDR, (byte)1) != 1 ) {
+		_counters.i2cErrors++;
+		return 0;
+	}
+	return _wire->read();
 }
 
 
 /**
- * Define the magnetic declination for accurate degrees.
- * https://www.magnetic-declination.com/
- * 
- * @example
- * For: Londrina, PR, Brazil at date 2022-12-05
- * The magnetic declination is: -19º 43'
- * 
- * then: setMagneticDeclination(-19, 43);
- */
-void QMC5883LCompass::setMagneticDeclination(int degrees, uint8_t minutes) {
-	_magneticDeclinationDegrees = degrees + minutes / 60;
+	STREAMING
+	Cut the I2C traffic of each read. Call this after init().
+	
+	Every read starts at the STATUS register (0x06) and uses the pointer roll-over of the chip
+	to continue with XYZ, so DRDY and DOR are read before the data clears them. With streaming
+	on, the register pointer stays parked on the STATUS register. Every read is then a single
+	7 byte read transaction without a pointer write, and readIfReady() needs no extra
+	transaction to check DRDY.
+	
+	With temperature on, each read instead is one combined transaction (pointer write and
+	repeated start) that reads XYZ, the status and the temperature (0x00 - 0x08). The
+	roll-over can't cover the temperature registers, so it is left off in this case, and
+	read() gets the status after the data, when the chip has already cleared DRDY and DOR.
+	readIfReady() still reports both.
+	
+	setReset() restores the roll-over setting after the reset.
+	
+	@since v1.3.0
+**/
+void QMC5883LCompass::setStreaming(bool enable, bool temperature){
+	_streamMode = enable ? (temperature ? 2 : 1) : 0;
+	_updateReg(0x0A, (_streamMode == 2) ? (_ctrl2 & ~0x40) : (_ctrl2 | 0x40));
 }
 
 
 /**
-	RESET
-	Reset the chip.
+	CHIP MODE
+	Set the chip mode.
 	
 	@since v0.1;
 **/
-// Reset the chip
-void QMC5883LCompass::setReset(){
-	_writeReg(0x0A,0x80);
-}
-
-// 1 = Basic 2 = Advanced
-void QMC5883LCompass::setSmoothing(byte steps, bool adv){
-	_smoothUse = true;
-	_smoothSteps = ( steps > 10) ? 10 : steps;
-	_smoothAdvanced = (adv == true) ? true : false;
+// Set chip mode
+void QMC5883LCompass::setMode(byte mode, byte odr, byte rng, byte osr){
+	_updateReg(0x09, mode|odr|rng|osr);
+#if QMC5883L_ENABLE_TIMING
+	_timingCount = 0;
+#endif
+#if QMC5883L_ENABLE_SMOOTHING
+	_updateFilter();
+#endif
 }
 
-void QMC5883LCompass::calibrate() {
-	clearCalibration();
-	long calibrationData[3][2] = {{65000, -65000}, {65000, -65000}, {65000, -65000}};
-  	long	x = calibrationData[0][0] = calibrationData[0][1] = getX();
-  	long	y = calibrationData[1][0] = calibrationData[1][1] = getY();
-  	long	z = calibrationData[2][0] = calibrationData[2][1] = getZ();
-
-	unsigned long startTime = millis();
-
-	while((millis() - startTime) < 10000) {
-		read();
 
-  		x = getX();
-  		y = getY();
-  		z = getZ();
+/**
+	STANDBY
+	Put the chip into standby. It stops measuring and draws only a few uA. The settings of
+	setMode() are kept, call wake() or setMode() to start measuring again.
+	
+	@since v1.3.0
+**/
+void QMC5883LCompass::standby(){
+	_updateReg(0x09, _ctrl1 & ~0x03);
+}
 
-		if(x < calibrationData[0][0]) {
-			calibrationData[0][0] = x;
-		}
-		if(x > calibrationData[0][1]) {
-			calibrationData[0][1] = x;
-		}
 
-		if(y < calibrationData[1][0]) {
-			calibrationData[1][0] = y;
-		}
-		if(y > calibrationData[1][1]) {
-			calibrationData[1][1] = y;
-		}
+/**
+	WAKE
+	Put the chip back into continuous mode after standby(). The first new measurement is ready
+	after one output data rate period.
+	
+	@since v1.3.0
+**/
+void QMC5883LCompass::wake(){
+	_updateReg(0x09, (_ctrl1 & ~0x03) | 0x01);
+}
 
-		if(z < calibrationData[2][0]) {
-			calibrationData[2][0] = z;
-		}
-		if(z > calibrationData[2][1]) {
-			calibrationData[2][1] = z;
-		}
-	}
 
-	setCalibration(
-		calibrationData[0][0],
-		calibrationData[0][1],
-		calibrationData[1][0],
-		calibrationData[1][1],
-		calibrationData[2][0],
-		calibrationData[2][1]
-	);
+/**
+	ESTIMATE ENERGY
+	Rough energy the chip uses for one readOnce(samples) at a given over sample ratio, in nJ.
+	Each measurement takes a charge proportional to the OSR, the output data rate only changes
+	how long it takes (@see estimateReadTime()). Standby current between readings is not
+	included. This is a model based on the QMC5883L_EST_* assumptions at the top of
+	QMC5883LCompass.cpp, not a measurement.
+	
+	e.g. OSR 512, 1 sample: about 24 uJ. OSR 64, 1 sample: about 3 uJ.
+	
+	@since v1.3.0
+	@param osr OSR value as used with setMode(), 0x00 - 0xC0.
+	@return uint32_t energy in nJ
+**/
+uint32_t QMC5883LCompass::estimateEnergy(byte osr, byte samples){
+	uint32_t ratio = 512 >> ((osr >> 6) & 0x03);
+	// Up to 6 * 10^9 before the division, more than 32 bits hold.
+	return (uint64_t)samples * ratio * QMC5883L_EST_NC_PER_OSR * QMC5883L_EST_SUPPLY_MV / 1000;
 }
 
+
 /**
-    SET CALIBRATION
-	Set calibration values for more accurate readings
-		
-	@author Claus Näveke - TheNitek [https://github.com/TheNitek]
+	ESTIMATE READ TIME
+	How long readOnce(samples) keeps the chip (and your sketch) awake at a given output data
+	rate, in ms. Bus time is not included.
 	
-	@since v1.1.0
-
-	@deprecated Instead of setCalibration, use the calibration offset and scale methods.
+	@since v1.3.0
+	@param odr ODR value as used with setMode(), 0x00 - 0x0C.
+	@return uint16_t time in ms
 **/
-void QMC5883LCompass::setCalibration(int x_min, int x_max, int y_min, int y_max, int z_min, int z_max){
-	setCalibrationOffsets(
-		(x_min + x_max)/2,
-		(y_min + y_max)/2,
-		(z_min + z_max)/2
-	);
-
-	float x_avg_delta = (x_max - x_min)/2;
-	float y_avg_delta = (y_max - y_min)/2;
-	float z_avg_delta = (z_max - z_min)/2;
+uint16_t QMC5883LCompass::estimateReadTime(byte odr, byte samples){
+	static const uint16_t periods[4] = {100, 20, 10, 5};
+	return (uint16_t)samples * periods[(odr >> 2) & 0x03];
+}
 
-	float avg_delta = (x_avg_delta + y_avg_delta + z_avg_delta) / 3;
 
-	setCalibrationScales(
-		avg_delta / x_avg_delta,
-		avg_delta / y_avg_delta,
-		avg_delta / z_avg_delta
-	);
+/**
+	AUTO RANGE
+	Switch the range between 2G and 8G on its own. At 2G the chip switches to 8G as soon as a
+	sample overflows or an axis goes above 20000. At 8G it switches back once all axis stay
+	below 4000 (16000 at 2G) for 16 new measurements in a row. Reading the same measurement
+	again does not count.
+	
+	getX() etc. are in LSB of the current range. The smoothing history and calibration offsets
+	are rescaled on every switch, so values stay continuous. Use @see getMilliGauss() for values
+	that don't depend on the range. Samples are dropped after a switch until the chip has a
+	measurement taken entirely at the new range, which takes one to two output data rate
+	periods.
+	
+	@since v1.3.0
+**/
+void QMC5883LCompass::setAutoRange(bool enable){
+	_autoRange = enable;
+	_rangeSkip = false;
+	_rangeLow = 0;
+	_rangeLowTime = micros();
 }
 
-void QMC5883LCompass::setCalibrationOffsets(float x_offset, float y_offset, float z_offset) {
-	_offset[0] = x_offset;
-	_offset[1] = y_offset;
-	_offset[2] = z_offset;
-}
 
-void QMC5883LCompass::setCalibrationScales(float x_scale, float y_scale, float z_scale) {
-	_scale[0] = x_scale;
-	_scale[1] = y_scale;
-	_scale[2] = z_scale;
+#if QMC5883L_ENABLE_DISTURBANCE
+/**
+	SET DISTURBANCE DETECTION
+	Watch the strength of the calibrated field for magnetic disturbances, e.g. motors, steel or
+	cables next to the sensor. Once calibrated, the strength of the earth field is the same in
+	every direction, so a change in strength or a field that suddenly gets noisy means the
+	heading can't be trusted.
+	
+	The detector learns the normal strength over the first 16 samples and then follows it
+	slowly while there is no disturbance. Start it where the field is clean. It starts over
+	whenever the calibration changes, or when this is called again.
+	
+	@since v1.3.0
+	@param threshold Disturbance in percent of the normal field at which isDisturbed() turns
+					 true. It turns false again below half of it.
+	@param freeze	 While disturbed, don't feed samples to the smoothing and the background
+					 calibration. getX() etc. then hold the last undisturbed smoothed values if
+					 smoothing is on.
+**/
+void QMC5883LCompass::setDisturbanceDetection(bool enable, byte threshold, bool freeze){
+	_distUse = enable;
+	_distThreshold = threshold;
+	_distFreeze = freeze;
+	_distCount = 0;
+	_distScore = 0;
+	_disturbed = false;
 }
 
-float QMC5883LCompass::getCalibrationOffset(uint8_t index) {
-	return _offset[index];
-}
 
-float QMC5883LCompass::getCalibrationScale(uint8_t index) {
-	return _scale[index];
+/**
+	IS DISTURBED
+	@since v1.3.0
+	@return bool true while a magnetic disturbance is detected
+**/
+bool QMC5883LCompass::isDisturbed(){
+	return _disturbed;
 }
 
-void QMC5883LCompass::clearCalibration(){
-	setCalibrationOffsets(0., 0., 0.);
-	setCalibrationScales(1., 1., 1.);
-}
 
 /**
-	READ
-	Read the XYZ axis and save the values in an array.
+	GET DISTURBANCE
+	How far the field is off, in percent of the normal field strength: the change of the
+	average strength plus twice its average deviation. A clean field scores a few percent.
 	
-	@since v0.1;
+	@since v1.3.0
+	@return byte disturbance, 0 - 255
 **/
-void QMC5883LCompass::read(){
-	Wire.beginTransmission(_ADDR);
-	Wire.write(0x00);
-	int err = Wire.endTransmission();
-	if (!err) {
-		Wire.requestFrom(_ADDR, (byte)6);
-		_vRaw[0] = (int)(int16_t)(Wire.read() | Wire.read() << 8);
-		_vRaw[1] = (int)(int16_t)(Wire.read() | Wire.read() << 8);
-		_vRaw[2] = (int)(int16_t)(Wire.read() | Wire.read() << 8);
-
-		_applyCalibration();
-		
-		if ( _smoothUse ) {
-			_smoothing();
-		}
-		
-		//byte overflow = Wire.read() & 0x02;
-		//return overflow << 2;
-	}
+byte QMC5883LCompass::getDisturbance(){
+	return _distScore;
 }
 
+
 /**
-    APPLY CALIBRATION
-	This function uses the calibration data provided via @see setCalibration() to calculate more
-	accurate readings
+	DISTURBANCE STEP
+	Update the detector with the calibrated sample. The field strength is tracked in 2G units
+	and 1/16 count, as a fast moving average and average deviation over about 8 samples,
+	against the normal strength averaged over about 256 samples. One integer square root
+	per sample.
 	
-	@author Claus Näveke - TheNitek [https://github.com/TheNitek]
+	@since v1.3.0
+**/
+void QMC5883LCompass::_disturbanceStep(){
+	long v[3] = {_vCalibrated[0], _vCalibrated[1], _vCalibrated[2]};
+	byte shift = ( _ctrl1 & 0x10 ) ? 6 : 4;
+	while ( labs(v[0]) > 0x7FFF || labs(v[1]) > 0x7FFF || labs(v[2]) > 0x7FFF ) {
+		v[0] /= 2;
+		v[1] /= 2;
+		v[2] /= 2;
+		shift++;
+	}
+	long norm = (long)_isqrt( (uint32_t)(v[0] * v[0]) + (uint32_t)(v[1] * v[1]) + (uint32_t)(v[2] * v[2]) ) << shift;
 	
-	Based on this awesome article:
-	https://appelsiini.net/2018/calibrate-magnetometer/
+	if ( _distCount < 16 ) {
+		_distCount++;
+		_distRef += ( norm - _distRef ) / _distCount;
+		_distMean = _distRef;
+		_distDev = 0;
+		return;
+	}
 	
-	@since v1.1.0
+	long e = norm - _distMean;
+	_distMean += e / 8;
+	_distDev += ( labs(e) - _distDev ) / 8;
+	long score = ( labs(_distMean - _distRef) + 2 * _distDev ) * 100 / ( _distRef > 0 ? _distRef : 1 );
+	_distScore = ( score > 255 ) ? 255 : score;
 	
-**/
-void QMC5883LCompass::_applyCalibration(){
-	_vCalibrated[0] = (_vRaw[0] - _offset[0]) * _scale[0];
-	_vCalibrated[1] = (_vRaw[1] - _offset[1]) * _scale[1];
-	_vCalibrated[2] = (_vRaw[2] - _offset[2]) * _scale[2];
+	if ( _disturbed ) {
+		_disturbed = ( score >= _distThreshold / 2 );
+	} else {
+		_disturbed = ( score > _distThreshold );
+	}
+	if ( !_disturbed ) {
+		_distRef += ( norm - _distRef ) / 256;
+	}
 }
+#endif
 
 
 /**
-	SMOOTH OUTPUT
-	This function smooths the output for the XYZ axis. Depending on the options set in
-	@see setSmoothing(), we can run multiple methods of smoothing the sensor readings.
+	AUTO RANGE STEP
+	Check a new sample against the auto range limits and switch if needed.
 	
-	First we store (n) samples of sensor readings for each axis and store them in a rolling array.
-	As each new sensor reading comes in we replace it with a new reading. Then we average the total
-	of all (n) readings.
+	@since v1.3.0
+	@return bool true if the sample must be dropped
+**/
+bool QMC5883LCompass::_autoRangeStep(const QMC5883LSample& s){
+	static const uint32_t periods[4] = {100000, 20000, 10000, 5000};
+	uint32_t period = periods[(_ctrl1 >> 2) & 0x03];
+	bool fresh = s.status & QMC5883L_STATUS_DRDY;
 	
-	Advanced Smoothing
-	If you turn advanced smoothing on, we will select the min and max values from our array
-	of (n) samples. We then subtract both the min and max from the total and average the total of all
-	(n - 2) readings.
+	if ( _rangeSkip ) {
+		// The measurement running during the switch may still be at the old range, those
+		// finished up to one period after it. Keep the first sample that is certainly newer:
+		// a new one (DRDY) read after a read past that point, or any read one period later.
+		// Tight loops re-read old measurements in between, so a single drop is not enough.
+		int32_t since = (int32_t)(s.t - _rangeTime - period);
+		if ( since < 0 ) {
+			return true;
+		}
+		if ( since < (int32_t)period && !(fresh && _rangeSeen) ) {
+			_rangeSeen = true;
+			return true;
+		}
+		_rangeSkip = false;
+		_rangeLowTime = s.t;
+	}
 	
-	NOTE: This function does several calculations and can cause your sketch to run slower.
+	int peak = abs(s.x);
+	peak = ( abs(s.y) > peak ) ? abs(s.y) : peak;
+	peak = ( abs(s.z) > peak ) ? abs(s.z) : peak;
 	
-	@since v0.3;
+	if ( !(_ctrl1 & 0x10) ) {
+		if ( (s.status & QMC5883L_STATUS_OVL) || peak > 20000 ) {
+			_switchRange(0x10);
+			return true;
+		}
+	} else if ( !(s.status & QMC5883L_STATUS_OVL) && peak < 4000 ) {
+		// Only count new measurements. Without DRDY (temperature streaming), at most one per period.
+		if ( fresh || s.t - _rangeLowTime >= period ) {
+			_rangeLowTime = s.t;
+			if ( ++_rangeLow >= 16 ) {
+				_switchRange(0x00);
+				return true;
+			}
+		}
+	} else {
+		_rangeLow = 0;
+	}
+	return false;
+}
+
+
+/**
+	RESCALE
+	Convert a value to another range. 2G readings are 4 times as large as 8G readings.
+	
+	@since v1.3.0
+	@return long rescaled value, limited to limit
 **/
-void QMC5883LCompass::_smoothing(){
-	byte max = 0;
-	byte min = 0;
+static long _rescale(long v, bool up, long limit){
+	if ( up ) {
+		return ( v + 2 ) >> 2;
+	}
+	return constrain(v, -limit / 4, limit / 4) * 4;
+}
+
+
+/**
+	SWITCH RANGE
+	Set a new RNG on the chip and rescale all values that depend on it.
 	
-	if ( _vScan > _smoothSteps - 1 ) { _vScan = 0; }
+	@since v1.3.0
+**/
+void QMC5883LCompass::_switchRange(byte rng){
+	bool up = ( rng == 0x10 );
+	_updateReg(0x09, (_ctrl1 & ~0x30) | rng);
+	_rangeTime = micros();
+	_rangeSkip = true;
+	_rangeSeen = false;
+	_rangeLow = 0;
+	_cached = 0;
 	
 	for ( int i = 0; i < 3; i++ ) {
-		if ( _vTotals[i] != 0 ) {
-			_vTotals[i] = _vTotals[i] - _vHistory[_vScan][i];
+		_vRaw[i] = _rescale(_vRaw[i], up, 32767);
+		_vCalibrated[i] = _rescale(_vCalibrated[i], up, 32767);
+#if QMC5883L_ENABLE_SMOOTHING
+		_vSmooth[i] = _rescale(_vSmooth[i], up, 32767);
+		if ( _filter == QMC5883L_FILTER_EMA || _filter == QMC5883L_FILTER_LOWPASS ) {
+			_vFilter[i] = _rescale(_vFilter[i], up, 32767L * 65536);
+		} else if ( _filter == QMC5883L_FILTER_MEDIAN3 ) {
+			_vPrev[0][i] = _rescale(_vPrev[0][i], up, 32767);
+			_vPrev[1][i] = _rescale(_vPrev[1][i], up, 32767);
 		}
-		_vHistory[_vScan][i] = _vCalibrated[i];
-		_vTotals[i] = _vTotals[i] + _vHistory[_vScan][i];
-		
-		if ( _smoothAdvanced ) {
-			max = 0;
-			for (int j = 0; j < _smoothSteps - 1; j++) {
-				max = ( _vHistory[j][i] > _vHistory[max][i] ) ? j : max;
-			}
-			
-			min = 0;
-			for (int k = 0; k < _smoothSteps - 1; k++) {
-				min = ( _vHistory[k][i] < _vHistory[min][i] ) ? k : min;
+#if QMC5883L_SMOOTH_MAX_STEPS
+		else if ( _filter == QMC5883L_FILTER_BOXCAR ) {
+			// Slots 0 .. _vCount - 1 are in use. The running sum must match the history exactly.
+			_vTotals[i] = 0;
+			for ( byte n = 0; n < _vCount; n++ ) {
+				_vHistory[n][i] = _rescale(_vHistory[n][i], up, 32767);
+				_vTotals[i] += _vHistory[n][i];
 			}
-					
-			_vSmooth[i] = ( _vTotals[i] - (_vHistory[max][i] + _vHistory[min][i]) ) / (_smoothSteps - 2);
-		} else {
-			_vSmooth[i] = _vTotals[i]  / _smoothSteps;
 		}
+#endif
+#endif
+#if QMC5883L_ENABLE_CALIBRATION
+		_offset[i] = up ? _offset[i] / 4 : _offset[i] * 4;
+		_tcSlope[i] = up ? _tcSlope[i] / 4 : _tcSlope[i] * 4;
+		_calMin[i] = _rescale(_calMin[i], up, 32767);
+		_calMax[i] = _rescale(_calMax[i], up, 32767);
+#endif
 	}
-	
-	_vScan++;
+#if QMC5883L_ENABLE_CALIBRATION
+	_updateCalibration();
+#endif
 }
 
 
 /**
-	GET X AXIS
-	Read the X axis
+	OUTPUT DATA RATE
+	Get the output data rate currently set on the chip in Hz.
 	
-	@since v0.1;
-	@return int x axis
+	@since v1.3.0
+	@return int output data rate
 **/
-int QMC5883LCompass::getX(){
-	return _get(0);
+int QMC5883LCompass::_odrHz(){
+	static const int rates[4] = {10, 50, 100, 200};
+	return rates[(_ctrl1 >> 2) & 0x03];
 }
 
 
 /**
-	GET Y AXIS
-	Read the Y axis
+ * Define the magnetic declination for accurate degrees.
+ * https://www.magnetic-declination.com/
+ * 
+ * @example
+ * For: Londrina, PR, Brazil at date 2022-12-05
+ * The magnetic declination is: -19º 43'
+ * 
+ * then: setMagneticDeclination(-19, 43);
+ *
+ * The minutes take the sign of the degrees. The declination is kept in hundredths of a degree.
+ */
+void QMC5883LCompass::setMagneticDeclination(int degrees, uint8_t minutes) {
+	int centi = abs(degrees) * 100 + (minutes * 100 + 30) / 60;
+	_declination = ( degrees < 0 ) ? -centi : centi;
+	_cached = 0;
+}
+
+
+/**
+	RESET
+	Reset the chip.
 	
 	@since v0.1;
-	@return int y axis
+	@since v1.3.0 - the settings are restored after the reset.
 **/
-int QMC5883LCompass::getY(){
-	return _get(1);
+// Reset the chip
+void QMC5883LCompass::setReset(){
+	MuxScope scope(*this);
+	_shadowValid = 0;
+	_writeReg(0x0A,0x80);
+	_restoreConfig();
 }
 
 
 /**
-	GET Z AXIS
-	Read the Z axis
+	VERIFY CONFIG
+	Read the control registers back in one burst and compare them to the settings the
+	library has made. If they differ, e.g. because the chip lost power for a moment, the
+	settings are written again.
 	
-	@since v0.1;
-	@return int z axis
+	@since v1.3.0
+	@return bool true if the chip still had the expected settings
 **/
-int QMC5883LCompass::getZ(){
-	return _get(2);
+bool QMC5883LCompass::verifyConfig(){
+	MuxScope scope(*this);
+	_pointerParked = false;
+	_select();
+	_wire->beginTransmission(_ADDR);
+	_wire->write(0x09);
+	if ( _wire->endTransmission() == 0 && _wire->requestFrom(_ADDR, (byte)3) == 3 ) {
+		byte ctrl1 = _wire->read();
+		byte ctrl2 = _wire->read();
+		byte period = _wire->read();
+		// SOFT_RST always reads back as 0.
+		if ( ctrl1 == _ctrl1 && ctrl2 == (_ctrl2 & 0x7F) && period == _period ) {
+			return true;
+		}
+	} else {
+		_counters.i2cErrors++;
+	}
+	_restoreConfig();
+	return false;
 }
 
+
 /**
-	GET SENSOR AXIS READING
-	Get the smoothed, calibration, or raw data from a given sensor axis
+	RESTORE CONFIG
+	Write all control registers from the shadow copies.
 	
-	@since v1.1.0
-	@return int sensor axis value
+	@since v1.3.0
 **/
-int QMC5883LCompass::_get(int i){
-	if ( _smoothUse ) 
-		return _vSmooth[i];
-	
-	return _vCalibrated[i];
+void QMC5883LCompass::_restoreConfig(){
+	_shadowValid = 0;
+	_updateReg(0x0B, _period);
+	_updateReg(0x0A, _ctrl2);
+	_updateReg(0x09, _ctrl1);
 }
 
 
-
 /**
-	GET AZIMUTH
-	Calculate the azimuth (in degrees);
-	Correct the value with magnetic declination if defined. 
+	UPDATE REGISTER
+	Write a control register (0x09 - 0x0B) and keep a shadow copy of it. Writes that would not
+	change the register are skipped.
 	
-	@since v0.1;
-	@return int azimuth
+	@since v1.3.0
+	@return bool false if the chip did not answer
 **/
-int QMC5883LCompass::getAzimuth(){
-	float heading = atan2( getY(), getX() ) * 180.0 / PI;
-	heading += _magneticDeclinationDegrees;
-	return (int)heading % 360;
+bool QMC5883LCompass::_updateReg(byte r, byte v){
+	byte bit = 1 << (r - 0x09);
+	byte& shadow = ( r == 0x09 ) ? _ctrl1 : ( r == 0x0A ) ? _ctrl2 : _period;
+	if ( (_shadowValid & bit) && shadow == v ) {
+		return true;
+	}
+	shadow = v;
+	if ( !_writeReg(r, v) ) {
+		_shadowValid &= ~bit;
+		return false;
+	}
+	_shadowValid |= bit;
+	return true;
 }
 
 
 /**
-	GET BEARING
-	Divide the 360 degree circle into 16 equal parts and then return the a value of 0-15
-	based on where the azimuth is currently pointing.
+	GET MODE / ODR / RANGE / OSR
+	Current chip settings, in the same values as used with @see setMode().
+	
+	@since v1.3.0
+	@return byte setting
+**/
+byte QMC5883LCompass::getMode(){
+	return _ctrl1 & 0x03;
+}
+
+byte QMC5883LCompass::getODR(){
+	return _ctrl1 & 0x0C;
+}
+
+byte QMC5883LCompass::getRange(){
+	return _ctrl1 & 0x30;
+}
+
+byte QMC5883LCompass::getOSR(){
+	return _ctrl1 & 0xC0;
+}
+
+#if QMC5883L_ENABLE_SMOOTHING && QMC5883L_SMOOTH_MAX_STEPS
+// 1 = Basic 2 = Advanced
+// Steps are capped at QMC5883L_SMOOTH_MAX_STEPS. Changing them restarts the window.
+void QMC5883LCompass::setSmoothing(byte steps, bool adv){
+	_smoothUse = true;
+	_filter = QMC5883L_FILTER_BOXCAR;
+#if QMC5883L_SMOOTH_MAX_STEPS < 255
+	_smoothSteps = ( steps > QMC5883L_SMOOTH_MAX_STEPS) ? QMC5883L_SMOOTH_MAX_STEPS : steps;
+#else
+	_smoothSteps = steps;
+#endif
+	_smoothSteps = ( _smoothSteps < 1 ) ? 1 : _smoothSteps;
+	_smoothAdvanced = (adv == true) ? true : false;
+	_resetSmoothing();
+}
+#endif
+
+#if QMC5883L_ENABLE_CALIBRATION
+/**
+	CALIBRATE
+	Collect calibration data for 10 seconds while the sensor is moved around, then apply it.
+	
+	@since v1.2.0
+	@since v1.3.0 - uses the calibration engine, only reads new samples.
+**/
+void QMC5883LCompass::calibrate() {
+	startCalibration(false);
+	
+	unsigned long startTime = millis();
+	
+	while((millis() - startTime) < 10000) {
+		if ( !readIfReady() ) {
+			yield();
+		}
+	}
+	
+	stopCalibration(true);
+}
+
+
+/**
+	START CALIBRATION
+	Start collecting calibration data in the background. Every new sample that goes through
+	read() (or any of the other read functions) updates the min / max of each axis and the
+	coverage of the directions seen so far, which takes a few compares per sample.
+	
+	With autoApply on, the new offsets and scales are applied once the coverage reaches
+	QMC5883L_CALIBRATION_COVERAGE % and the min / max have not grown by more than 1/64 of their
+	range for one second. Offsets and scales are swapped in together between two samples.
+	The current calibration stays in use until then.
+	
+	@since v1.3.0
+**/
+void QMC5883LCompass::startCalibration(bool autoApply){
+	_calRunning = true;
+	_calAuto = autoApply;
+	_calSamples = 0;
+	_calStable = 0;
+	_calBins = 0;
+}
+
+
+/**
+	STOP CALIBRATION
+	Stop collecting calibration data. With apply on, the data collected so far is applied and
+	the smoothing starts over, since it holds readings corrected with the old values.
+	
+	@since v1.3.0
+	@return bool true if new calibration values were applied
+**/
+bool QMC5883LCompass::stopCalibration(bool apply){
+	if ( !_calRunning ) {
+		return false;
+	}
+	_calRunning = false;
+	
+	if ( !apply || _calSamples == 0 ) {
+		return false;
+	}
+	for ( int i = 0; i < 3; i++ ) {
+		if ( _calMax[i] <= _calMin[i] ) {
+			return false;
+		}
+	}
+	setCalibration(
+		_calMin[0], _calMax[0],
+		_calMin[1], _calMax[1],
+		_calMin[2], _calMax[2]
+	);
+#if QMC5883L_ENABLE_SMOOTHING
+	// The filter state holds readings corrected with the old values.
+	_resetSmoothing();
+#endif
+	return true;
+}
+
+
+/**
+	IS CALIBRATING
+	@since v1.3.0
+	@return bool true while calibration data is collected
+**/
+bool QMC5883LCompass::isCalibrating(){
+	return _calRunning;
+}
+
+
+/**
+	GET CALIBRATION COVERAGE
+	How much of the sphere of directions has been covered by the calibration data, in percent.
+	Directions are split into 24 bins (dominant axis, its sign and the signs of the other two
+	axes) around the current center estimate.
+	
+	@since v1.3.0
+	@return byte coverage 0 - 100
+**/
+byte QMC5883LCompass::getCalibrationCoverage(){
+	byte bins = 0;
+	for ( uint32_t b = _calBins; b; b &= b - 1 ) {
+		bins++;
+	}
+	return bins * 100 / 24;
+}
+
+
+/**
+	CALIBRATION STEP
+	Add a raw sample to the calibration data.
+	
+	@since v1.3.0
+**/
+void QMC5883LCompass::_calibrationStep(){
+	bool grown = false;
+	
+	if ( _calSamples == 0 ) {
+		for ( int i = 0; i < 3; i++ ) {
+			_calMin[i] = _vRaw[i];
+			_calMax[i] = _vRaw[i];
+		}
+	}
+	if ( _calSamples < 0xFFFF ) {
+		_calSamples++;
+	}
+	
+	// Spans of 16 bit values need 17 bits, so they are long (int is 16 bits on AVR).
+	long d[3];
+	long dMax = 0;
+	long radius = 0;
+	byte axis = 0;
+	for ( int i = 0; i < 3; i++ ) {
+		long v = _vRaw[i];
+		long range = ((long)_calMax[i] - _calMin[i]) >> 6;
+		if ( v < _calMin[i] ) {
+			grown |= ( _calMin[i] - v > range );
+			_calMin[i] = v;
+		}
+		if ( v > _calMax[i] ) {
+			grown |= ( v - _calMax[i] > range );
+			_calMax[i] = v;
+		}
+		
+		d[i] = v - ( ((long)_calMin[i] + _calMax[i]) >> 1 );
+		long half = ((long)_calMax[i] - _calMin[i]) >> 1;
+		if ( half > radius ) {
+			radius = half;
+		}
+		if ( labs(d[i]) > dMax ) {
+			dMax = labs(d[i]);
+			axis = i;
+		}
+	}
+	
+	// Readings close to the center don't tell us much about their direction.
+	if ( dMax > radius / 2 ) {
+		byte bin = axis * 8 + (d[axis] < 0) * 4 + (d[(axis + 1) % 3] < 0) * 2 + (d[(axis + 2) % 3] < 0);
+		_calBins |= 1UL << bin;
+	}
+	
+	_calStable = grown ? 0 : _calStable + ( _calStable < 0xFFFF );
+	
+	if ( _calAuto && _calStable >= _odrHz() && getCalibrationCoverage() >= QMC5883L_CALIBRATION_COVERAGE ) {
+		// The current sample goes on to the freshly reset smoothing, so correct it with the new values.
+		if ( stopCalibration(true) ) {
+			_applyCalibration();
+		}
+	}
+}
+
+/**
+    SET CALIBRATION
+	Set calibration values for more accurate readings
+		
+	@author Claus Näveke - TheNitek [https://github.com/TheNitek]
+	
+	@since v1.1.0
+
+	@deprecated Instead of setCalibration, use the calibration offset and scale methods.
+	@since v1.3.0 - turns the calibration matrix off.
+**/
+void QMC5883LCompass::setCalibration(int x_min, int x_max, int y_min, int y_max, int z_min, int z_max){
+#if QMC5883L_ENABLE_CALIBRATION_MATRIX
+	_calMatrixUse = false;
+#endif
+	setCalibrationOffsets(
+		((long)x_min + x_max)/2,
+		((long)y_min + y_max)/2,
+		((long)z_min + z_max)/2
+	);
+
+	float x_avg_delta = ((long)x_max - x_min)/2;
+	float y_avg_delta = ((long)y_max - y_min)/2;
+	float z_avg_delta = ((long)z_max - z_min)/2;
+
+	float avg_delta = (x_avg_delta + y_avg_delta + z_avg_delta) / 3;
+
+	setCalibrationScales(
+		avg_delta / x_avg_delta,
+		avg_delta / y_avg_delta,
+		avg_delta / z_avg_delta
+	);
+}
+
+void QMC5883LCompass::setCalibrationOffsets(float x_offset, float y_offset, float z_offset) {
+	_offset[0] = x_offset;
+	_offset[1] = y_offset;
+	_offset[2] = z_offset;
+	// New offsets hold at the temperature they were measured at, @see setTemperatureCompensation().
+	_tcRef = _tcTemp;
+	_updateCalibration();
+#if QMC5883L_ENABLE_DISTURBANCE
+	_distCount = 0;
+#endif
+}
+
+void QMC5883LCompass::setCalibrationScales(float x_scale, float y_scale, float z_scale) {
+	_scale[0] = x_scale;
+	_scale[1] = y_scale;
+	_scale[2] = z_scale;
+	_updateCalibration();
+#if QMC5883L_ENABLE_DISTURBANCE
+	_distCount = 0;
+#endif
+}
+
+/**
+	UPDATE CALIBRATION
+	Turn the float offsets and scales into the fixed-point values used by @see _applyCalibration().
+	
+	offset = integer part + fraction
+	scale  = mantissa / 2^shift, with the mantissa as large as fits in 16 bits
+	bias   = fraction * mantissa, so the fraction of the offset is not lost
+	
+	The offsets are shifted by the temperature compensation for the last temperature it was
+	computed at, @see setTemperatureCompensation().
+	
+	@since v1.3.0
+**/
+void QMC5883LCompass::_updateCalibration(){
+	for ( int i = 0; i < 3; i++ ) {
+		float offset = _offset[i] + _tcSlope[i] * (_tcTemp - _tcRef) / 100;
+		float whole = floor(offset);
+		_calOffset[i] = constrain(whole, -32768.0f, 32767.0f);
+		
+		float scale = fabs(_scale[i]);
+		byte shift = 30;
+		while ( shift > 0 && scale * (1L << shift) > 32767.0 ) {
+			shift--;
+		}
+		_calShift[i] = shift;
+		_calScale[i] = constrain(lround(_scale[i] * (1L << shift)), -32767L, 32767L);
+		_calBias[i] = lround((offset - whole) * _calScale[i]);
+	}
+}
+
+/**
+	SET TEMPERATURE COMPENSATION
+	Let the offsets follow the temperature of the chip. Each offset moves by its slope, in
+	counts per degree C at the current range, for every degree away from the reference:
+	
+	offset = calibration offset + slope * (temperature - reference) / 100
+	
+	The reference is the raw temperature (@see getTemperature()) the offsets were calibrated
+	at. The temperature is only read when streaming with temperature is on
+	(@see setStreaming()), the offsets are recomputed once it moved by
+	QMC5883L_TEMPERATURE_STEP. All slopes 0 turns the compensation off.
+	
+	Offsets set later, by a calibration or @see setCalibrationOffsets(), are taken to be for the
+	current temperature and move the reference there. Call this after setting offsets that were
+	calibrated at another temperature.
+	
+	@since v1.3.0
+**/
+void QMC5883LCompass::setTemperatureCompensation(float x_slope, float y_slope, float z_slope, int reference){
+	_tcSlope[0] = x_slope;
+	_tcSlope[1] = y_slope;
+	_tcSlope[2] = z_slope;
+	_tcRef = reference;
+	_tcTemp = reference;
+	_tcUse = ( x_slope != 0 || y_slope != 0 || z_slope != 0 );
+	_updateCalibration();
+#if QMC5883L_ENABLE_DISTURBANCE
+	_distCount = 0;
+#endif
+}
+
+float QMC5883LCompass::getTemperatureSlope(uint8_t index){
+	return _tcSlope[index];
+}
+
+int QMC5883LCompass::getTemperatureReference(){
+	return _tcRef;
+}
+
+#if QMC5883L_ENABLE_CALIBRATION_MATRIX
+/**
+	SET CALIBRATION MATRIX
+	Set a 3x3 soft-iron correction matrix. It is applied after the offsets and scales:
+	
+	calibrated = matrix * ((raw - offset) * scale)
+	
+	The matrix is applied in fixed-point with 12 fraction bits, so entries must be between
+	-4 and 4. An identity matrix turns the matrix off.
+	
+	@since v1.3.0
+**/
+void QMC5883LCompass::setCalibrationMatrix(const float matrix[3][3]){
+	bool identity = true;
+	for ( int i = 0; i < 3; i++ ) {
+		for ( int j = 0; j < 3; j++ ) {
+			_matrix[i][j] = matrix[i][j];
+			_calMatrix[i][j] = constrain(lround(matrix[i][j] * 4096), -16383L, 16383L);
+			identity &= ( _calMatrix[i][j] == ( i == j ? 4096 : 0 ) );
+		}
+	}
+	_calMatrixUse = !identity;
+#if QMC5883L_ENABLE_DISTURBANCE
+	_distCount = 0;
+#endif
+}
+
+float QMC5883LCompass::getCalibrationMatrix(uint8_t row, uint8_t col){
+	return _matrix[row][col];
+}
+
+
+/**
+	SOLVE
+	Solve a * x = b with n unknowns by Gaussian elimination with partial pivoting. a is n x n,
+	row major, and is overwritten. b is replaced by x.
+	
+	@since v1.3.0
+	@return bool false if a is singular
+**/
+static bool _solve(float* a, float* b, byte n){
+	for ( byte c = 0; c < n; c++ ) {
+		byte p = c;
+		for ( byte r = c + 1; r < n; r++ ) {
+			if ( fabs(a[r * n + c]) > fabs(a[p * n + c]) ) {
+				p = r;
+			}
+		}
+		if ( fabs(a[p * n + c]) < 1e-12 ) {
+			return false;
+		}
+		if ( p != c ) {
+			for ( byte k = 0; k < n; k++ ) {
+				float t = a[c * n + k]; a[c * n + k] = a[p * n + k]; a[p * n + k] = t;
+			}
+			float t = b[c]; b[c] = b[p]; b[p] = t;
+		}
+		for ( byte r = c + 1; r < n; r++ ) {
+			float f = a[r * n + c] / a[c * n + c];
+			for ( byte k = c; k < n; k++ ) {
+				a[r * n + k] -= f * a[c * n + k];
+			}
+			b[r] -= f * b[c];
+		}
+	}
+	for ( int r = n - 1; r >= 0; r-- ) {
+		for ( byte k = r + 1; k < n; k++ ) {
+			b[r] -= a[r * n + k] * b[k];
+		}
+		b[r] /= a[r * n + r];
+	}
+	return true;
+}
+
+
+/**
+	EIGEN
+	Eigenvalues and eigenvectors of a symmetric 3x3 matrix with Jacobi rotations. a ends up
+	diagonal with the eigenvalues, the columns of v are the eigenvectors.
+	
+	@since v1.3.0
+**/
+static void _eigen(float a[3][3], float v[3][3]){
+	for ( int i = 0; i < 3; i++ ) {
+		for ( int j = 0; j < 3; j++ ) {
+			v[i][j] = ( i == j );
+		}
+	}
+	
+	for ( int sweep = 0; sweep < 16; sweep++ ) {
+		if ( fabs(a[0][1]) + fabs(a[0][2]) + fabs(a[1][2]) < 1e-9 ) {
+			return;
+		}
+		for ( int p = 0; p < 2; p++ ) {
+			for ( int q = p + 1; q < 3; q++ ) {
+				if ( a[p][q] == 0 ) {
+					continue;
+				}
+				float theta = (a[q][q] - a[p][p]) / (2 * a[p][q]);
+				float t = ( theta < 0 ? -1 : 1 ) / ( fabs(theta) + sqrt(theta * theta + 1) );
+				float c = 1 / sqrt(t * t + 1);
+				float s = t * c;
+				for ( int k = 0; k < 3; k++ ) {
+					float kp = a[k][p], kq = a[k][q];
+					a[k][p] = c * kp - s * kq;
+					a[k][q] = s * kp + c * kq;
+				}
+				for ( int k = 0; k < 3; k++ ) {
+					float pk = a[p][k], qk = a[q][k];
+					a[p][k] = c * pk - s * qk;
+					a[q][k] = s * pk + c * qk;
+				}
+				for ( int k = 0; k < 3; k++ ) {
+					float kp = v[k][p], kq = v[k][q];
+					v[k][p] = c * kp - s * kq;
+					v[k][q] = s * kp + c * kq;
+				}
+			}
+		}
+	}
+}
+
+
+/**
+	FIT CALIBRATION MATRIX
+	Fit an ellipsoid to a batch of raw readings taken while the sensor was turned in all
+	directions, and set the offsets, scales and matrix that turn it into a sphere. The sphere
+	has the same volume as the ellipsoid, so readings keep about the same magnitude.
+	
+	Least-squares fit of A x^2 + B y^2 + C z^2 + 2D xy + 2E xz + 2F yz + 2G x + 2H y + 2I z = 1
+	on readings scaled to -1 .. 1. The matrix is the square root of the ellipsoid matrix.
+	Uses about 400 bytes of stack.
+	
+	@since v1.3.0
+	@param samples Raw x, y, z readings, e.g. getX() etc. with the calibration cleared.
+	@param count Number of readings, at least 9. 50 or more from all directions work well.
+	@return bool false if the readings don't describe an ellipsoid, calibration is unchanged.
+**/
+bool QMC5883LCompass::fitCalibrationMatrix(const int16_t samples[][3], uint16_t count){
+	if ( count < 9 ) {
+		return false;
+	}
+	
+	float mean[3] = {0., 0., 0.};
+	for ( uint16_t n = 0; n < count; n++ ) {
+		for ( int i = 0; i < 3; i++ ) {
+			mean[i] += samples[n][i];
+		}
+	}
+	for ( int i = 0; i < 3; i++ ) {
+		mean[i] /= count;
+	}
+	float norm = 0;
+	for ( uint16_t n = 0; n < count; n++ ) {
+		for ( int i = 0; i < 3; i++ ) {
+			norm = fmax(norm, fabs(samples[n][i] - mean[i]));
+		}
+	}
+	if ( norm == 0 ) {
+		return false;
+	}
+	
+	// Normal equations, only the upper triangle is summed.
+	float ata[9][9];
+	float atb[9];
+	memset(ata, 0, sizeof(ata));
+	memset(atb, 0, sizeof(atb));
+	for ( uint16_t n = 0; n < count; n++ ) {
+		float x = (samples[n][0] - mean[0]) / norm;
+		float y = (samples[n][1] - mean[1]) / norm;
+		float z = (samples[n][2] - mean[2]) / norm;
+		float r[9] = {x * x, y * y, z * z, 2 * x * y, 2 * x * z, 2 * y * z, 2 * x, 2 * y, 2 * z};
+		for ( int i = 0; i < 9; i++ ) {
+			for ( int j = i; j < 9; j++ ) {
+				ata[i][j] += r[i] * r[j];
+			}
+			atb[i] += r[i];
+		}
+	}
+	for ( int i = 0; i < 9; i++ ) {
+		for ( int j = 0; j < i; j++ ) {
+			ata[i][j] = ata[j][i];
+		}
+	}
+	if ( !_solve(&ata[0][0], atb, 9) ) {
+		return false;
+	}
+	
+	// Center: q * c = -(G, H, I)
+	float q[3][3] = {
+		{atb[0], atb[3], atb[4]},
+		{atb[3], atb[1], atb[5]},
+		{atb[4], atb[5], atb[2]}
+	};
+	float c[3] = {-atb[6], -atb[7], -atb[8]};
+	float m[3][3];
+	memcpy(m, q, sizeof(m));
+	if ( !_solve(&m[0][0], c, 3) ) {
+		return false;
+	}
+	float k = 1 - (atb[6] * c[0] + atb[7] * c[1] + atb[8] * c[2]);
+	if ( k <= 0 ) {
+		return false;
+	}
+	
+	// matrix = sqrt(q / k), scaled to a determinant of 1
+	float v[3][3];
+	_eigen(q, v);
+	float det = 1;
+	for ( int i = 0; i < 3; i++ ) {
+		if ( q[i][i] <= 0 ) {
+			return false;
+		}
+		det *= q[i][i] / k;
+	}
+	float root[3];
+	for ( int i = 0; i < 3; i++ ) {
+		root[i] = sqrt(q[i][i] / k) / pow(det, 1.0 / 6);
+	}
+	for ( int i = 0; i < 3; i++ ) {
+		for ( int j = 0; j < 3; j++ ) {
+			m[i][j] = 0;
+			for ( int e = 0; e < 3; e++ ) {
+				m[i][j] += v[i][e] * root[e] * v[j][e];
+			}
+			if ( fabs(m[i][j]) >= 4 ) {
+				return false;
+			}
+		}
+	}
+	
+	setCalibrationOffsets(
+		mean[0] + c[0] * norm,
+		mean[1] + c[1] * norm,
+		mean[2] + c[2] * norm
+	);
+	setCalibrationScales(1., 1., 1.);
+	setCalibrationMatrix(m);
+	return true;
+}
+#endif
+
+float QMC5883LCompass::getCalibrationOffset(uint8_t index) {
+	return _offset[index];
+}
+
+float QMC5883LCompass::getCalibrationScale(uint8_t index) {
+	return _scale[index];
+}
+
+/**
+	SAVE CALIBRATION
+	Write the offsets, scales, matrix and temperature compensation to a buffer of QMC5883L_CALIBRATION_SIZE bytes, e.g.
+	to store them in EEPROM or Preferences and restore them with @see loadCalibration().
+	
+	Layout: "QC", version, flags (bit 0 = matrix on, bits 4-5 = RNG of the offsets), 3 float
+	offsets, 3 float scales, 9 float matrix entries, 3 float temperature slopes, float reference
+	temperature, CRC-16 (low byte first).
+	
+	@since v1.3.0
+	@return size_t bytes written, 0 if the buffer is too small
+**/
+size_t QMC5883LCompass::saveCalibration(uint8_t* buffer, size_t size){
+	if ( size < QMC5883L_CALIBRATION_SIZE ) {
+		return 0;
+	}
+	
+	float values[19];
+	for ( int i = 0; i < 3; i++ ) {
+		values[i] = _offset[i];
+		values[3 + i] = _scale[i];
+		values[15 + i] = _tcSlope[i];
+		for ( int j = 0; j < 3; j++ ) {
+#if QMC5883L_ENABLE_CALIBRATION_MATRIX
+			values[6 + i * 3 + j] = _matrix[i][j];
+#else
+			values[6 + i * 3 + j] = ( i == j );
+#endif
+		}
+	}
+	values[18] = _tcRef;
+	
+	buffer[0] = 'Q';
+	buffer[1] = 'C';
+	buffer[2] = QMC5883L_CALIBRATION_VERSION;
+	buffer[3] = _ctrl1 & 0x30;
+#if QMC5883L_ENABLE_CALIBRATION_MATRIX
+	buffer[3] |= _calMatrixUse;
+#endif
+	memcpy(buffer + 4, values, sizeof(values));
+	
+	uint16_t crc = crc16(buffer, QMC5883L_CALIBRATION_SIZE - 2);
+	buffer[QMC5883L_CALIBRATION_SIZE - 2] = crc;
+	buffer[QMC5883L_CALIBRATION_SIZE - 1] = crc >> 8;
+	return QMC5883L_CALIBRATION_SIZE;
+}
+
+
+/**
+	LOAD CALIBRATION
+	Restore calibration data written by @see saveCalibration(). Data that is damaged, empty,
+	from another version, or uses the matrix while it is compiled out is rejected. Offsets and
+	temperature slopes taken at another range are converted to the current one.
+	
+	Call it after init() / begin() and after setting the range. Before init() the range of the
+	chip is not known yet, so nothing is loaded.
+	
+	@since v1.3.0
+	@return bool true if the calibration was restored, false leaves the calibration unchanged
+**/
+bool QMC5883LCompass::loadCalibration(const uint8_t* buffer, size_t size){
+	if ( _shadowValid == 0 ) {
+		return false;
+	}
+	if ( size < QMC5883L_CALIBRATION_SIZE || buffer[0] != 'Q' || buffer[1] != 'C' || buffer[2] != QMC5883L_CALIBRATION_VERSION ) {
+		return false;
+	}
+	uint16_t crc = buffer[QMC5883L_CALIBRATION_SIZE - 2] | (uint16_t)buffer[QMC5883L_CALIBRATION_SIZE - 1] << 8;
+	if ( crc != crc16(buffer, QMC5883L_CALIBRATION_SIZE - 2) ) {
+		return false;
+	}
+	if ( (buffer[3] & 0x20) || (_ctrl1 & 0x20) ) {
+		return false;
+	}
+#if !QMC5883L_ENABLE_CALIBRATION_MATRIX
+	if ( buffer[3] & 0x01 ) {
+		return false;
+	}
+#endif
+	
+	float values[19];
+	memcpy(values, buffer + 4, sizeof(values));
+	for ( int i = 0; i < 19; i++ ) {
+		if ( !isfinite(values[i]) ) {
+			return false;
+		}
+	}
+	
+	memcpy(_offset, values, sizeof(_offset));
+	float slope[3];
+	memcpy(slope, values + 15, sizeof(slope));
+	if ( (buffer[3] ^ _ctrl1) & 0x10 ) {
+		for ( int i = 0; i < 3; i++ ) {
+			_offset[i] = ( _ctrl1 & 0x10 ) ? _offset[i] / 4 : _offset[i] * 4;
+			slope[i] = ( _ctrl1 & 0x10 ) ? slope[i] / 4 : slope[i] * 4;
+		}
+	}
+	memcpy(_scale, values + 3, sizeof(_scale));
+	setTemperatureCompensation(slope[0], slope[1], slope[2], lround(values[18]));
+#if QMC5883L_ENABLE_CALIBRATION_MATRIX
+	float matrix[3][3];
+	memcpy(matrix, values + 6, sizeof(matrix));
+	setCalibrationMatrix(matrix);
+	_calMatrixUse &= buffer[3] & 0x01;
+#endif
+	return true;
+}
+
+void QMC5883LCompass::clearCalibration(){
+	setCalibrationOffsets(0., 0., 0.);
+	setCalibrationScales(1., 1., 1.);
+	setTemperatureCompensation(0., 0., 0., 0);
+#if QMC5883L_ENABLE_CALIBRATION_MATRIX
+	const float identity[3][3] = {{1.,0.,0.},{0.,1.,0.},{0.,0.,1.}};
+	setCalibrationMatrix(identity);
+#endif
+}
+#endif
+
+/**
+	READ
+	Read the XYZ axis and save the values in an array.
+	
+	Samples with an axis out of range (OVL) are counted but not used, the previous values are
+	kept. The STATUS register is read before the data, so DRDY tells whether the sample is new
+	and DOR whether measurements were missed since the last read. With the temperature
+	streaming mode, @see setStreaming(), read() can't report DRDY and DOR.
+	
+	@since v0.1;
+	@since v1.3.0 - returns the status.
+	@return byte QMC5883L_STATUS_* bits of the sample, QMC5883L_STATUS_I2C_ERROR if the chip did not answer
+**/
+byte QMC5883LCompass::read(){
+	QMC5883LSample s;
+	if ( !_readSample(s) ) {
+		_status = QMC5883L_STATUS_I2C_ERROR;
+		return _status;
+	}
+	_processSample(s);
+	return s.status;
+}
+
+
+/**
+	READ ALL
+	Read a list of compasses back-to-back, e.g. a sensor array spread over several I2C
+	buses or multiplexer channels.
+	
+	Each compass sits on its own bus or channel, so each read still takes one channel select
+	and one data burst (plus the pointer write outside of streaming mode). Turn on
+	setStreaming() for the shortest reads.
+	
+	@since v1.3.0
+**/
+void QMC5883LCompass::readAll(QMC5883LCompass* compasses[], uint8_t count){
+	for ( uint8_t i = 0; i < count; i++ ) {
+		compasses[i]->read();
+	}
+}
+
+
+/**
+	READ SAMPLE
+	Burst read the STATUS register and the XYZ axis (0x06, then 0x00 - 0x05 by roll-over) into
+	a sample. With the temperature streaming mode it is 0x00 - 0x08 instead.
+	
+	@since v1.3.0
+	@return bool true if the chip answered with all 7 bytes
+**/
+bool QMC5883LCompass::_readSample(QMC5883LSample& s){
+	uint32_t t = micros();
+	_select();
+	if ( !_setPointer(_streamMode == 0) || !_requestSample() ) {
+		QMC5883L_PROBE_STOP(i2c, t, false);
+		return false;
+	}
+	_unpackSample(s);
+	QMC5883L_PROBE_STOP(i2c, t, true);
+	s.t = t;
+	return true;
+}
+
+
+/**
+	SET POINTER
+	Point the chip at the first register of a data burst, the STATUS register or 0x00 with the
+	temperature streaming mode. In streaming mode the pointer stays parked on the STATUS
+	register after each burst, so nothing needs to be sent.
+	
+	@since v1.3.0
+	@return bool false if the chip did not answer
+**/
+bool QMC5883LCompass::_setPointer(bool stop){
+	if ( _streamMode == 1 && _pointerParked ) {
+		return true;
+	}
+	_wire->beginTransmission(_ADDR);
+	_wire->write( (_streamMode == 2) ? 0x00 : 0x06 );
+	if ( _wire->endTransmission(stop) ) {
+		_counters.i2cErrors++;
+		return false;
+	}
+	return true;
+}
+
+
+/**
+	REQUEST SAMPLE
+	Request a data burst from the chip.
+	
+	@since v1.3.0
+	@return bool true if the chip answered with all bytes of the burst
+**/
+bool QMC5883LCompass::_requestSample(){
+	byte len = _burstLength();
+	if ( _wire->requestFrom(_ADDR, len) != len ) {
+		_pointerParked = false;
+		_counters.i2cErrors++;
+		return false;
+	}
+	_pointerParked = (_streamMode == 1);
+	return true;
+}
+
+
+/**
+	BURST LENGTH
+	Number of bytes in a data burst, depending on the streaming mode.
+	
+	@since v1.3.0
+	@return byte burst length
+**/
+byte QMC5883LCompass::_burstLength(){
+	return (_streamMode == 2) ? 9 : 7;
+}
+
+
+/**
+	UNPACK SAMPLE
+	Unpack a data burst waiting in the I2C receive buffer.
+	
+	@since v1.3.0
+**/
+void QMC5883LCompass::_unpackSample(QMC5883LSample& s){
+	if ( _streamMode != 2 ) {
+		s.status = _wire->read();
+	}
+	
+	// The low byte must be read first, so don't let both reads end up in one expression.
+	int16_t v[3];
+	for ( int i = 0; i < 3; i++ ) {
+		byte lsb = _wire->read();
+		byte msb = _wire->read();
+		v[i] = (int16_t)( lsb | (msb << 8) );
+	}
+	s.x = v[0];
+	s.y = v[1];
+	s.z = v[2];
+	
+	s.temperature = _vTemp;
+	if ( _streamMode == 2 ) {
+		s.status = _wire->read();
+		byte lsb = _wire->read();
+		byte msb = _wire->read();
+		s.temperature = (int16_t)( lsb | (msb << 8) );
+	}
+}
+
+
+/**
+	START READ
+	First phase of a split-phase read. Sets the register pointer of the chip to the data
+	registers (nothing to do in streaming mode) and returns. Follow up with pollRead() and finishRead().
+	
+	Each phase issues at most one I2C transaction, so a control loop can run between them.
+	The transactions themselves still block like any Wire call. Don't mix other calls that
+	talk to the chip into a pending split-phase read.
+	
+	@since v1.3.0
+	@return bool false if a read is already pending or the chip did not answer
+**/
+bool QMC5883LCompass::startRead(){
+	if ( _readState != 0 ) {
+		return false;
+	}
+	_readTime = micros();
+	_select();
+	if ( !_setPointer(true) ) {
+		return false;
+	}
+	_readState = 1;
+	return true;
+}
+
+
+/**
+	POLL READ
+	Second phase of a split-phase read. The first call requests the data burst, later calls
+	check whether all bytes have arrived. requestFrom() blocks until the whole burst is in on
+	the AVR, ESP and SAMD cores, so there the first call takes the time of the transfer and
+	returns true.
+	
+	If the chip does not answer, the pending read is dropped and startRead() can be called
+	again.
+	
+	@since v1.3.0
+	@return bool true once finishRead() can be called
+**/
+bool QMC5883LCompass::pollRead(){
+	if ( _readState == 1 ) {
+		_select();
+		if ( !_requestSample() ) {
+			_readState = 0;
+			return false;
+		}
+		_readState = 2;
+	}
+	return _readState == 2 && _wire->available() >= _burstLength();
+}
+
+
+/**
+	FINISH READ
+	Last phase of a split-phase read. Unpacks the received bytes and runs calibration and
+	smoothing on them, just like read() does.
+	
+	@since v1.3.0
+	@return bool true if new data was processed
+**/
+bool QMC5883LCompass::finishRead(){
+	if ( !pollRead() ) {
+		return false;
+	}
+	QMC5883LSample s;
+	_unpackSample(s);
+	s.t = _readTime;
+	_readState = 0;
+	_processSample(s);
+	return true;
+}
+
+
+/**
+	PROCESS SAMPLE
+	Count a raw sample, store it and run it through calibration and smoothing. Samples with
+	an axis out of range are dropped so they don't end up in the smoothing or calibration.
+	
+	@since v1.3.0
+**/
+void QMC5883LCompass::_processSample(const QMC5883LSample& s){
+	_status = s.status;
+	_vTemp = s.temperature;
+	_counters.reads++;
+#if QMC5883L_ENABLE_TIMING
+	_updateTiming(s.t);
+#endif
+	_timestamp = s.t;
+	if ( s.status & QMC5883L_STATUS_DOR ) {
+		_counters.skipped++;
+	}
+	if ( s.status & QMC5883L_STATUS_OVL ) {
+		_counters.overflows++;
+	}
+	if ( _autoRange && _autoRangeStep(s) ) {
+		return;
+	}
+	if ( s.status & QMC5883L_STATUS_OVL ) {
+		return;
+	}
+	
+	_sampleId++;
+	_cached = 0;
+	_vRaw[0] = s.x;
+	_vRaw[1] = s.y;
+	_vRaw[2] = s.z;
+	
+	QMC5883L_PROBE_START(calibrationStart);
+	_applyCalibration();
+	QMC5883L_PROBE_STOP(calibration, calibrationStart, true);
+	
+	// Keep disturbed samples out of the smoothing and calibration state.
+#if QMC5883L_ENABLE_CALIBRATION || QMC5883L_ENABLE_SMOOTHING
+	bool frozen = false;
+#endif
+#if QMC5883L_ENABLE_DISTURBANCE
+	if ( _distUse ) {
+		_disturbanceStep();
+#if QMC5883L_ENABLE_CALIBRATION || QMC5883L_ENABLE_SMOOTHING
+		frozen = _distFreeze && _disturbed;
+#endif
+	}
+#endif
+	
+#if QMC5883L_ENABLE_CALIBRATION
+	if ( _calRunning && !frozen ) {
+		_calibrationStep();
+	}
+#endif
+	
+#if QMC5883L_ENABLE_SMOOTHING
+	if ( _smoothUse && !frozen ) {
+		QMC5883L_PROBE_START(smoothingStart);
+		_smoothing();
+		QMC5883L_PROBE_STOP(smoothing, smoothingStart, true);
+	}
+#endif
+	
+	if ( _headingCallback || _bearingCallback || _trackRate ) {
+		_trackHeading();
+	}
+}
+
+
+/**
+	DATA AVAILABLE
+	Check the DRDY bit of the status register (0x06) to see if the chip has finished a
+	new measurement that has not been read yet.
+	
+	@since v1.3.0
+	@return bool true if a new measurement is waiting
+**/
+bool QMC5883LCompass::available(){
+	return _readReg(0x06) & 0x01;
+}
+
+
+/**
+	READ IF READY
+	Read the XYZ axis only if the chip has a new measurement. Calibration and smoothing are
+	only run on fresh samples, so the smoothing window is filled with real samples only and
+	no bus time is spent pulling the same measurement twice.
+	
+	@since v1.3.0
+	@return bool true if new data was read
+**/
+bool QMC5883LCompass::readIfReady(){
+	MuxScope scope(*this);
+	QMC5883LSample s;
+	if ( !_readIfReady(s) ) {
+		return false;
+	}
+	_processSample(s);
+	return true;
+}
+
+
+/**
+	READ SAMPLE IF READY
+	Read a raw sample only if the chip has a new measurement.
+	
+	@since v1.3.0
+	@return bool true if the sample holds new data
+**/
+bool QMC5883LCompass::_readIfReady(QMC5883LSample& s){
+	// In streaming mode the status comes with the data burst.
+	if ( _streamMode == 1 ) {
+		return _readSample(s) && (s.status & QMC5883L_STATUS_DRDY);
+	}
+	
+	// A short status read is cheaper to poll than a data burst. With the temperature the
+	// status comes after the data, when DRDY and DOR are cleared, so keep them from the status
+	// read before. The measurement was ready before that read.
+	uint32_t t = micros();
+	byte status = _readReg(0x06);
+	if ( !(status & QMC5883L_STATUS_DRDY) || !_readSample(s) ) {
+		return false;
+	}
+	s.status |= status & (QMC5883L_STATUS_DRDY | QMC5883L_STATUS_DOR);
+	s.t = t;
+	return true;
+}
+
+
+/**
+	READ BURST
+	Collect a number of new measurements into an array, e.g. for logging. Only fresh samples
+	are stored, each one with its STATUS register and micros() timestamp. The axis values are
+	raw, getX() etc. return the last sample calibrated and smoothed as usual.
+	
+	Blocks until all samples are read. To keep the bus free, the chip is not polled for the
+	first 3/4 of each output data rate period.
+	
+	@since v1.3.0
+	@param samples Array of at least count samples.
+	@param timeout Give up when no new measurement arrives within this many ms.
+	@return size_t number of samples read
+**/
+size_t QMC5883LCompass::readBurst(QMC5883LSample* samples, size_t count, unsigned long timeout){
+	MuxScope scope(*this);
+	uint32_t quiet = 750000UL / _odrHz();
+	uint32_t notBefore = micros();
+	size_t n = 0;
+	
+	while ( n < count && _waitSample(samples[n], notBefore, timeout) ) {
+		_processSample(samples[n]);
+		notBefore = samples[n].t + quiet;
+		n++;
+	}
+	return n;
+}
+
+
+/**
+	WAIT FOR SAMPLE
+	Poll the chip until it has a new measurement. Polling starts at notBefore (micros()).
+	
+	@since v1.3.0
+	@return bool false if there was no new measurement within timeout ms
+**/
+bool QMC5883LCompass::_waitSample(QMC5883LSample& s, uint32_t notBefore, unsigned long timeout){
+	unsigned long start = millis();
+	
+	while ( true ) {
+		if ( (long)(micros() - notBefore) >= 0 && _readIfReady(s) ) {
+			return true;
+		}
+		if ( millis() - start >= timeout ) {
+			return false;
+		}
+		yield();
+	}
+}
+
+
+/**
+	READ ONCE
+	Wake the chip, read and average a number of new measurements and put the chip back into
+	standby. For battery powered projects that only need a reading every now and then. The
+	average goes through calibration and smoothing like a single reading.
+	
+	Takes about samples / ODR, @see estimateReadTime() and estimateEnergy().
+	
+	@since v1.3.0
+	@param samples Number of measurements to average.
+	@param timeout Give up when no new measurement arrives within this many ms.
+	@return byte QMC5883L_STATUS_* bits of the reading (OR of all samples), 0 if nothing was read
+	in time, QMC5883L_STATUS_I2C_ERROR if the chip did not answer
+**/
+byte QMC5883LCompass::readOnce(byte samples, unsigned long timeout){
+	MuxScope scope(*this);
+	uint32_t errors = _counters.i2cErrors;
+	uint32_t quiet = 750000UL / _odrHz();
+	samples = ( samples < 1 ) ? 1 : samples;
+	
+	wake();
+	
+	QMC5883LSample s;
+	long sum[3] = {0, 0, 0};
+	byte status = 0;
+	byte n = 0;
+	uint32_t notBefore = micros() + quiet;
+	while ( n < samples && _waitSample(s, notBefore, timeout) ) {
+		sum[0] += s.x;
+		sum[1] += s.y;
+		sum[2] += s.z;
+		status |= s.status;
+		notBefore = s.t + quiet;
+		n++;
+	}
+	
+	standby();
+	
+	if ( n == 0 ) {
+		_status = ( _counters.i2cErrors != errors ) ? QMC5883L_STATUS_I2C_ERROR : 0;
+		return _status;
+	}
+	
+	for ( int i = 0; i < 3; i++ ) {
+		sum[i] = ( sum[i] + ( sum[i] < 0 ? -(n / 2) : n / 2 ) ) / n;
+	}
+	s.x = sum[0];
+	s.y = sum[1];
+	s.z = sum[2];
+	s.status = status;
+	_processSample(s);
+	return status;
+}
+
+
+#if QMC5883L_ENABLE_INTERRUPT
+/**
+	ENABLE INTERRUPT
+	Switch to interrupt driven acquisition. The DRDY pin of the chip is enabled and an
+	interrupt is attached to the given pin. The interrupt handler only flags and timestamps
+	the new measurement, call service() to move flagged measurements into the sample ring
+	and readSamples() to drain them.
+	
+	The sample ring is an array of the sketch, with a power of two size from 2 to 128. One
+	slot is always kept free, so it holds one sample less than its size. It must stay valid
+	until disableInterrupt().
+	
+	Up to four compass instances can use interrupt mode at the same time.
+	
+	@since v1.3.0
+	@param ring Array used as the sample ring, e.g. QMC5883LSample ring[16];
+	@return bool false if the pin can't be used as an interrupt or all slots are in use
+**/
+bool QMC5883LCompass::_enableInterrupt(byte pin, QMC5883LSample* ring, uint8_t size){
+	static void (* const handlers[4])() = { _isr0, _isr1, _isr2, _isr3 };
+	
+	int irq = digitalPinToInterrupt(pin);
+#ifdef NOT_AN_INTERRUPT
+	if ( irq == NOT_AN_INTERRUPT ) {
+		return false;
+	}
+#endif
+	
+	if ( _intSlot < 0 ) {
+		for ( int8_t i = 0; i < 4; i++ ) {
+			if ( _isrInstances[i] == nullptr ) {
+				_intSlot = i;
+				break;
+			}
+		}
+		if ( _intSlot < 0 ) {
+			return false;
+		}
+	} else {
+		detachInterrupt(digitalPinToInterrupt(_intPin));
+	}
+	
+	_isrInstances[_intSlot] = this;
+	_intPin = pin;
+	_drdyFlag = false;
+	_ring = ring;
+	_ringMask = size - 1;
+	_ringHead = 0;
+	_ringTail = 0;
+	
+	_updateReg(0x0A, _ctrl2 & ~0x01);
+	
+	// DRDY only rises on a new measurement, so clear any pending one first.
+	QMC5883LSample s;
+	_readSample(s);
+	
+	pinMode(pin, INPUT);
+	attachInterrupt(irq, handlers[_intSlot], RISING);
+	return true;
+}
+
+
+/**
+	DISABLE INTERRUPT
+	Detach the interrupt handler and disable the DRDY pin of the chip.
+	
+	@since v1.3.0
+**/
+void QMC5883LCompass::disableInterrupt(){
+	if ( _intSlot < 0 ) {
+		return;
+	}
+	detachInterrupt(digitalPinToInterrupt(_intPin));
+	_isrInstances[_intSlot] = nullptr;
+	_intSlot = -1;
+	_intPin = 0xFF;
+	_drdyFlag = false;
+	
+	_updateReg(0x0A, _ctrl2 | 0x01);
+}
+
+
+/**
+	SERVICE
+	Read a measurement flagged by the DRDY interrupt and push it into the sample ring. This
+	is the producer side of the ring. Call it often from loop(), e.g. between the steps of
+	slow work, so samples keep flowing while loop() is busy.
+	
+	Call it from the same context as readSamples() and all other calls. Only the ring
+	indices are safe to share, the counters, the bus and the other state are not. Calling it
+	from another task or a timer interrupt is not supported.
+	
+	If an edge was missed and the DRDY pin is still high, the pending measurement is read
+	anyway so acquisition can't stall.
+	
+	@since v1.3.0
+	@return bool true if a sample was added to the ring
+**/
+bool QMC5883LCompass::service(){
+	if ( _intSlot < 0 ) {
+		return false;
+	}
+	
+	uint32_t t;
+	noInterrupts();
+	bool flagged = _drdyFlag;
+	t = _drdyTime;
+	_drdyFlag = false;
+	interrupts();
+	
+	if ( !flagged ) {
+		if ( digitalRead(_intPin) != HIGH ) {
+			return false;
+		}
+		t = micros();
+	}
+	
+	QMC5883LSample s;
+	if ( !_readSample(s) ) {
+		return false;
+	}
+	s.t = t;
+	
+	uint8_t head = _ringHead;
+	uint8_t next = (head + 1) & _ringMask;
+	if ( next == _ringTail ) {
+		_counters.skipped++;
+		return false;
+	}
+	_ring[head] = s;
+	QMC5883L_MEMORY_BARRIER();
+	_ringHead = next;
+	return true;
+}
+
+
+/**
+	SAMPLES AVAILABLE
+	Number of samples waiting in the sample ring.
+	
+	@since v1.3.0
+	@return uint8_t number of samples
+**/
+uint8_t QMC5883LCompass::samplesAvailable(){
+	return (_ringHead - _ringTail) & _ringMask;
+}
+
+
+/**
+	READ SAMPLES
+	Drain up to max raw samples from the sample ring into the given array. This is the
+	consumer side of the ring. Every drained sample also goes through calibration and
+	smoothing, so getX(), getAzimuth() etc. reflect the newest one afterwards.
+	
+	@since v1.3.0
+	@return uint8_t number of samples copied
+**/
+uint8_t QMC5883LCompass::readSamples(QMC5883LSample* samples, uint8_t max){
+	uint8_t n = 0;
+	uint8_t tail = _ringTail;
+	uint8_t head = _ringHead;
+	QMC5883L_MEMORY_BARRIER();
+	
+	while ( tail != head && n < max ) {
+		samples[n] = _ring[tail];
+		_processSample(samples[n]);
+		tail = (tail + 1) & _ringMask;
+		n++;
+	}
+	
+	QMC5883L_MEMORY_BARRIER();
+	_ringTail = tail;
+	return n;
+}
+
+
+/**
+	DATA READY INTERRUPT
+	Flag and timestamp a new measurement. Runs in interrupt context, so no I2C here.
+	
+	@since v1.3.0
+**/
+void QMC5883L_ISR_ATTR QMC5883LCompass::_onDataReady(){
+	_drdyTime = micros();
+	_drdyFlag = true;
+}
+
+void QMC5883L_ISR_ATTR QMC5883LCompass::_isr0(){ _isrInstances[0]->_onDataReady(); }
+void QMC5883L_ISR_ATTR QMC5883LCompass::_isr1(){ _isrInstances[1]->_onDataReady(); }
+void QMC5883L_ISR_ATTR QMC5883LCompass::_isr2(){ _isrInstances[2]->_onDataReady(); }
+void QMC5883L_ISR_ATTR QMC5883LCompass::_isr3(){ _isrInstances[3]->_onDataReady(); }
+#endif
+
+
+/**
+	CRC-16
+	CRC-16/CCITT-FALSE (polynomial 0x1021) of a block of data. Pass the previous result as crc to
+	continue over several blocks.
+	
+	@since v1.3.0
+	@return uint16_t crc
+**/
+uint16_t QMC5883LCompass::crc16(const uint8_t* data, size_t length, uint16_t crc){
+	while ( length-- ) {
+		crc ^= (uint16_t)*data++ << 8;
+		for ( byte b = 0; b < 8; b++ ) {
+			crc = ( crc & 0x8000 ) ? ( crc << 1 ) ^ 0x1021 : crc << 1;
+		}
+	}
+	return crc;
+}
+
+
+/**
+    APPLY CALIBRATION
+	This function uses the calibration data provided via @see setCalibration() to calculate more
+	accurate readings
+	
+	@author Claus Näveke - TheNitek [https://github.com/TheNitek]
+	
+	Based on this awesome article:
+	https://appelsiini.net/2018/calibrate-magnetometer/
+	
+	The offsets and scales are applied in fixed-point (@see _updateCalibration()), which takes a
+	16 x 16 bit multiply per axis instead of float math. Results are within 1 LSB of
+	(raw - offset) * scale, truncated and limited to 16 bits. A calibration matrix adds a
+	3x3 multiply-add on top, @see setCalibrationMatrix().
+	
+	@since v1.1.0
+	@since v1.3.0 - fixed-point math, temperature compensation.
+	
+**/
+void QMC5883LCompass::_applyCalibration(){
+#if QMC5883L_ENABLE_CALIBRATION
+	// One compare per sample, the offsets are only recomputed when the temperature moved.
+	if ( _tcUse && _streamMode == 2 && abs(_vTemp - _tcTemp) >= QMC5883L_TEMPERATURE_STEP ) {
+		_tcTemp = _vTemp;
+		_updateCalibration();
+	}
+	
+	for ( int i = 0; i < 3; i++ ) {
+		long d = (long)_vRaw[i] - _calOffset[i];
+		
+		// 16 x 16 bit multiply unless the offset pushes d out of range. Either way the
+		// product fits in 32 bits since the mantissa is at most 15 bits.
+		long v = ( d == (int16_t)d ) ? (long)(int16_t)d * _calScale[i] : d * _calScale[i];
+		v -= _calBias[i];
+		if ( v < 0 ) {
+			v += (1L << _calShift[i]) - 1;
+		}
+		v >>= _calShift[i];
+		_vCalibrated[i] = constrain(v, -32768L, 32767L);
+	}
+	
+#if QMC5883L_ENABLE_CALIBRATION_MATRIX
+	if ( _calMatrixUse ) {
+		// 16 x 15 bit products, the sum of three still fits in 32 bits.
+		long s[3] = {_vCalibrated[0], _vCalibrated[1], _vCalibrated[2]};
+		for ( int i = 0; i < 3; i++ ) {
+			long v = (long)_calMatrix[i][0] * s[0] + (long)_calMatrix[i][1] * s[1] + (long)_calMatrix[i][2] * s[2];
+			_vCalibrated[i] = constrain((v + 2048) >> 12, -32768L, 32767L);
+		}
+	}
+#endif
+#else
+	_vCalibrated[0] = _vRaw[0];
+	_vCalibrated[1] = _vRaw[1];
+	_vCalibrated[2] = _vRaw[2];
+#endif
+}
+
+
+#if QMC5883L_ENABLE_SMOOTHING
+/**
+	SET FILTER
+	Select how readings are smoothed. The rolling average set up by @see setSmoothing() takes
+	a few bytes of RAM per step. The other filters only keep a few bytes per axis and take
+	constant time per reading:
+	
+	QMC5883L_FILTER_NONE		No smoothing.
+	QMC5883L_FILTER_BOXCAR		Rolling average, same as setSmoothing(param, false). Not available
+								if QMC5883L_SMOOTH_MAX_STEPS is 0.
+	QMC5883L_FILTER_EMA			Exponential moving average. Each reading moves the output by
+								1 / 2^param of the difference, param 1 - 15.
+	QMC5883L_FILTER_LOWPASS		First order low-pass with a cutoff of param Hz. The filter is
+								tuned to the output data rate set with @see setMode().
+	QMC5883L_FILTER_MEDIAN3		Median of the last three readings, removes single spikes.
+	
+	@since v1.3.0
+**/
+void QMC5883LCompass::setFilter(QMC5883LFilter filter, float param){
+	if ( filter == QMC5883L_FILTER_BOXCAR ) {
+#if QMC5883L_SMOOTH_MAX_STEPS
+		setSmoothing(param, false);
+		return;
+#else
+		filter = QMC5883L_FILTER_NONE;
+#endif
+	}
+	
+	_smoothUse = ( filter != QMC5883L_FILTER_NONE );
+	_filter = filter;
+	_filterParam = param;
+	_resetSmoothing();
+	_updateFilter();
+}
+
+
+/**
+	RESET SMOOTHING
+	Empty the filter state, so the next reading starts the filter over.
+	
+	@since v1.3.0
+**/
+void QMC5883LCompass::_resetSmoothing(){
+	_vCount = 0;
+	_cached = 0;
+#if QMC5883L_SMOOTH_MAX_STEPS
+	_vScan = 0;
+	for ( int i = 0; i < 3; i++ ) {
+		_vTotals[i] = 0;
+		_vMinHead[i] = 0;
+		_vMinLen[i] = 0;
+		_vMaxHead[i] = 0;
+		_vMaxLen[i] = 0;
+	}
+#endif
+}
+
+
+/**
+	UPDATE FILTER
+	Work out the fixed-point coefficient of the EMA and low-pass filters.
+	
+	Low-pass: alpha = dt / (RC + dt) with RC = 1 / (2 PI fc) and dt = 1 / ODR.
+	
+	@since v1.3.0
+**/
+void QMC5883LCompass::_updateFilter(){
+	float alpha = 0;
+	
+	if ( _filter == QMC5883L_FILTER_EMA ) {
+		byte shift = constrain((int)_filterParam, 1, 15);
+		_filterAlpha = 0x10000UL >> shift;
+		return;
+	}
+	if ( _filter == QMC5883L_FILTER_LOWPASS ) {
+		float wc = 2.0 * PI * _filterParam;
+		alpha = wc / (wc + _odrHz());
+	}
+	
+	// Q16, capped at 0.5 so the update can't overflow.
+	long a = alpha * 65536.0 + 0.5;
+	_filterAlpha = constrain(a, 1L, 32768L);
+}
+
+
+/**
+	SMOOTH OUTPUT
+	Run the reading through the filter selected with @see setSmoothing() / @see setFilter().
+	
+	@since v1.3.0
+**/
+void QMC5883LCompass::_smoothing(){
+	switch ( _filter ) {
+		case QMC5883L_FILTER_EMA:
+		case QMC5883L_FILTER_LOWPASS:
+			_smoothIIR();
+			break;
+		case QMC5883L_FILTER_MEDIAN3:
+			_smoothMedian();
+			break;
+		default:
+#if QMC5883L_SMOOTH_MAX_STEPS
+			_smoothBoxcar();
+#endif
+			break;
+	}
+}
+
+
+/**
+	IIR SMOOTHING
+	Exponential moving average / first order low-pass: y += alpha * (x - y).
+	
+	The state is kept in Q16 so slow filters don't stall on rounding. The difference is taken
+	against the rounded output, which keeps the product within 32 bits.
+	
+	@since v1.3.0
+**/
+void QMC5883LCompass::_smoothIIR(){
+	for ( int i = 0; i < 3; i++ ) {
+		if ( _vCount == 0 ) {
+			_vFilter[i] = (long)_vCalibrated[i] * 65536;
+		} else {
+			long e = (long)_vCalibrated[i] - _vSmooth[i];
+			_vFilter[i] += e * _filterAlpha;
+		}
+		_vSmooth[i] = (_vFilter[i] + 0x8000) >> 16;
+	}
+	_vCount = 1;
+}
+
+
+/**
+	MEDIAN SMOOTHING
+	Median of the current and the last two readings.
+	
+	@since v1.3.0
+**/
+void QMC5883LCompass::_smoothMedian(){
+	for ( int i = 0; i < 3; i++ ) {
+		int a = _vCalibrated[i];
+		
+		if ( _vCount < 2 ) {
+			_vSmooth[i] = a;
+		} else {
+			int b = _vPrev[0][i];
+			int c = _vPrev[1][i];
+			if ( a > b ) { int t = a; a = b; b = t; }
+			if ( b > c ) { b = c; }
+			_vSmooth[i] = ( a > b ) ? a : b;
+		}
+		
+		_vPrev[1][i] = _vPrev[0][i];
+		_vPrev[0][i] = _vCalibrated[i];
+	}
+	if ( _vCount < 2 ) {
+		_vCount++;
+	}
+}
+
+
+#if QMC5883L_SMOOTH_MAX_STEPS
+/**
+	BOXCAR SMOOTHING
+	This function smooths the output for the XYZ axis. Depending on the options set in
+	@see setSmoothing(), we can run multiple methods of smoothing the sensor readings.
+	
+	First we store (n) samples of sensor readings for each axis and store them in a rolling array.
+	As each new sensor reading comes in we replace it with a new reading. Then we average the total
+	of all (n) readings. Until (n) readings have come in, only the readings we have are averaged.
+	
+	Advanced Smoothing
+	If you turn advanced smoothing on, we will select the min and max values from our array
+	of (n) samples. We then subtract both the min and max from the total and average the total of all
+	(n - 2) readings.
+	
+	The total is kept as a running sum, and the min and max are tracked with one monotonic queue
+	of history slots per axis. Every sample enters and leaves each queue once, so the cost per
+	reading stays the same no matter how many steps are used.
+	
+	@since v0.3;
+	@since v1.3.0 - constant time per reading, the newest reading is no longer skipped by min / max.
+**/
+void QMC5883LCompass::_smoothBoxcar(){
+	byte slot = _vScan;
+	bool full = ( _vCount == _smoothSteps );
+	if ( !full ) {
+		_vCount++;
+	}
+	
+	for ( int i = 0; i < 3; i++ ) {
+		int v = _vCalibrated[i];
+		
+		// Drop the reading that falls out of the window. If it is still queued, it is the oldest
+		// entry and therefore at the front of its queue.
+		if ( full ) {
+			_vTotals[i] -= _vHistory[slot][i];
+			if ( _vMaxLen[i] && _vMaxQ[i][_vMaxHead[i]] == slot ) {
+				_vMaxHead[i] = _smoothNext(_vMaxHead[i]);
+				_vMaxLen[i]--;
+			}
+			if ( _vMinLen[i] && _vMinQ[i][_vMinHead[i]] == slot ) {
+				_vMinHead[i] = _smoothNext(_vMinHead[i]);
+				_vMinLen[i]--;
+			}
+		}
+		
+		_vHistory[slot][i] = v;
+		_vTotals[i] += v;
+		
+		if ( _smoothAdvanced ) {
+			// Readings that can never be the max (or min) again are removed from the back.
+			while ( _vMaxLen[i] && _vHistory[_vMaxQ[i][_smoothBack(_vMaxHead[i], _vMaxLen[i])]][i] <= v ) {
+				_vMaxLen[i]--;
+			}
+			_vMaxQ[i][_smoothBack(_vMaxHead[i], _vMaxLen[i] + 1)] = slot;
+			_vMaxLen[i]++;
+			
+			while ( _vMinLen[i] && _vHistory[_vMinQ[i][_smoothBack(_vMinHead[i], _vMinLen[i])]][i] >= v ) {
+				_vMinLen[i]--;
+			}
+			_vMinQ[i][_smoothBack(_vMinHead[i], _vMinLen[i] + 1)] = slot;
+			_vMinLen[i]++;
+		}
+		
+		if ( _smoothAdvanced && _vCount > 2 ) {
+			int max = _vHistory[_vMaxQ[i][_vMaxHead[i]]][i];
+			int min = _vHistory[_vMinQ[i][_vMinHead[i]]][i];
+			_vSmooth[i] = ( _vTotals[i] - ((long)max + min) ) / (_vCount - 2);
+		} else {
+			_vSmooth[i] = _vTotals[i] / _vCount;
+		}
+	}
+	
+	_vScan = _smoothNext(_vScan);
+}
+
+
+/**
+	SMOOTHING QUEUE INDEX
+	Step a history slot or queue position forward / find the last of (len) queue entries,
+	wrapping around at the current number of smoothing steps.
+	
+	@since v1.3.0
+**/
+byte QMC5883LCompass::_smoothNext(byte i){
+	return ( i + 1 >= _smoothSteps ) ? 0 : i + 1;
+}
+
+byte QMC5883LCompass::_smoothBack(byte head, unsigned int len){
+	// Above 128 steps head + len does not fit in a byte.
+	unsigned int i = head + len - 1;
+	return ( i >= _smoothSteps ) ? i - _smoothSteps : i;
+}
+#endif
+#endif
+
+
+/**
+	GET X AXIS
+	Read the X axis
+	
+	@since v0.1;
+	@return int x axis
+**/
+int QMC5883LCompass::getX(){
+	return _get(0);
+}
+
+
+/**
+	GET Y AXIS
+	Read the Y axis
+	
+	@since v0.1;
+	@return int y axis
+**/
+int QMC5883LCompass::getY(){
+	return _get(1);
+}
+
+
+/**
+	GET Z AXIS
+	Read the Z axis
+	
+	@since v0.1;
+	@return int z axis
+**/
+int QMC5883LCompass::getZ(){
+	return _get(2);
+}
+
+/**
+	GET XYZ AXIS
+	Get all three axis at once, same values as getX(), getY() and getZ().
+	
+	@since v1.3.0
+**/
+void QMC5883LCompass::getXYZ(int16_t& x, int16_t& y, int16_t& z){
+	const int* v = _vCalibrated;
+#if QMC5883L_ENABLE_SMOOTHING
+	if ( _smoothUse ) {
+		v = _vSmooth;
+	}
+#endif
+	x = v[0];
+	y = v[1];
+	z = v[2];
+}
+
+/**
+	GET MILLIGAUSS
+	Get an axis in milligauss, @see getX(). 2G: 12 LSB / mG, 8G: 3 LSB / mG.
+	
+	@since v1.3.0
+	@param index 0 = x, 1 = y, 2 = z
+	@return int axis value in mG
+**/
+int QMC5883LCompass::getMilliGauss(uint8_t index){
+	long v = _get(index);
+	int lsb = ( _ctrl1 & 0x10 ) ? 3 : 12;
+	return ( v + ( v < 0 ? -lsb / 2 : lsb / 2 ) ) / lsb;
+}
+
+
+/**
+	GET STATUS
+	Status of the last sample, @see read().
+	
+	@since v1.3.0
+	@return byte QMC5883L_STATUS_* bits
+**/
+byte QMC5883LCompass::getStatus(){
+	return _status;
+}
+
+
+/**
+	GET TIMESTAMP
+	micros() timestamp of the last sample, @see QMC5883LSample.
+	
+	@since v1.3.0
+	@return uint32_t timestamp
+**/
+uint32_t QMC5883LCompass::getTimestamp(){
+	return _timestamp;
+}
+
+
+/**
+	GET SAMPLE ID
+	A number that goes up by one for every sample that changed getX(), getAzimuth() etc.
+	Samples that were dropped (OVL, range switches) don't count. Compare it with the value
+	from the last time to skip work when nothing new has come in.
+	
+	@since v1.3.0
+	@return uint32_t sample id, 0 until the first sample
+**/
+uint32_t QMC5883LCompass::getSampleId(){
+	return _sampleId;
+}
+
+
+#if QMC5883L_ENABLE_TIMING
+/**
+	UPDATE TIMING
+	Track the time between samples and its jitter with a moving average over about 16
+	samples. Both are kept in 1/16 us.
+	
+	@since v1.3.0
+**/
+void QMC5883LCompass::_updateTiming(uint32_t t){
+	if ( _timingCount > 0 ) {
+		// Long gaps, e.g. readOnce() every few seconds, are limited so the math fits in 32 bits.
+		uint32_t dt = t - _timestamp;
+		long d = (long)( dt < 10000000UL ? dt : 10000000UL ) * 16;
+		if ( _timingCount == 1 ) {
+			_interval = d;
+			_jitter = 0;
+		} else {
+			long e = d - _interval;
+			_interval += e / 16;
+			_jitter += ( labs(e) - _jitter ) / 16;
+		}
+	}
+	if ( _timingCount < 3 ) {
+		_timingCount++;
+	}
+}
+
+
+/**
+	GET SAMPLE RATE
+	The measured rate at which new samples come in, in Hz. If this is lower than the output
+	data rate set with setMode(), the loop or the I2C bus can't keep up.
+	
+	@since v1.3.0
+	@return float sample rate, 0 until two samples have been read
+**/
+float QMC5883LCompass::getSampleRate(){
+	return ( _timingCount < 2 || _interval <= 0 ) ? 0 : 16e6 / _interval;
+}
+
+
+/**
+	GET SAMPLE INTERVAL
+	The average time between samples in us.
+	
+	@since v1.3.0
+	@return uint32_t interval
+**/
+uint32_t QMC5883LCompass::getSampleInterval(){
+	return ( _timingCount < 2 ) ? 0 : ( _interval + 8 ) >> 4;
+}
+
+
+/**
+	GET SAMPLE JITTER
+	The average deviation of the time between samples from @see getSampleInterval(), in us.
+	
+	@since v1.3.0
+	@return uint32_t jitter
+**/
+uint32_t QMC5883LCompass::getSampleJitter(){
+	return ( _timingCount < 3 ) ? 0 : ( _jitter + 8 ) >> 4;
+}
+#endif
+
+
+/**
+	GET COUNTERS
+	Running counters of reads and problems seen since start or since clearCounters(). They are
+	kept as samples come in, so checking them takes no bus traffic.
+	
+	@since v1.3.0
+	@return QMC5883LCounters counters
+**/
+QMC5883LCounters QMC5883LCompass::getCounters(){
+	return _counters;
+}
+
+
+/**
+	CLEAR COUNTERS
+	@since v1.3.0
+**/
+void QMC5883LCompass::clearCounters(){
+	_counters = {0, 0, 0, 0};
+}
+
+
+#if QMC5883L_ENABLE_INSTRUMENTATION
+/**
+	GET STATS
+	Durations of the instrumented sections since start or since clearStats(), in us. The
+	resolution is that of micros(), 4 us on 16MHz AVR boards. Split-phase reads are not
+	timed, their phases return before the transaction is done.
+	
+	@since v1.3.0
+	@return QMC5883LStats stats
+**/
+QMC5883LStats QMC5883LCompass::getStats(){
+	QMC5883LStats stats = _stats;
+	QMC5883LProbe* probes[4] = {&stats.i2c, &stats.calibration, &stats.smoothing, &stats.azimuth};
+	for ( byte i = 0; i < 4; i++ ) {
+		if ( probes[i]->count ) {
+			probes[i]->avg = probes[i]->total / probes[i]->count;
+		}
+	}
+	return stats;
+}
+
+
+/**
+	CLEAR STATS
+	@since v1.3.0
+**/
+void QMC5883LCompass::clearStats(){
+	_stats = {};
+}
+
+
+/**
+	PROBE
+	Add one run of an instrumented section that started at the given micros().
+	
+	@since v1.3.0
+**/
+void QMC5883LCompass::_probe(QMC5883LProbe& probe, uint32_t start, bool ok){
+	uint32_t us = micros() - start;
+	if ( !ok ) {
+		probe.errors++;
+	}
+	if ( probe.count == 0 || us < probe.min ) {
+		probe.min = us;
+	}
+	if ( us > probe.max ) {
+		probe.max = us;
+	}
+	probe.count++;
+	probe.total += us;
+}
+#endif
+
+
+/**
+	GET SENSOR AXIS READING
+	Get the smoothed, calibration, or raw data from a given sensor axis
+	
+	@since v1.1.0
+	@return int sensor axis value
+**/
+int QMC5883LCompass::_get(int i){
+#if QMC5883L_ENABLE_SMOOTHING
+	if ( _smoothUse ) 
+		return _vSmooth[i];
+#endif
+	
+	return _vCalibrated[i];
+}
+
+
+
+/**
+	GET TEMPERATURE
+	Get the temperature read with the last sample. Only updated when streaming with
+	temperature is on, @see setStreaming(). In interrupt mode it is the temperature of the
+	last sample drained with readSamples().
+	
+	The chip only gives a relative temperature, with 100 LSB per degree C.
+	
+	@since v1.3.0
+	@return int raw temperature
+**/
+int QMC5883LCompass::getTemperature(){
+	return _vTemp;
+}
+
+
+
+/**
+	GET AZIMUTH
+	Calculate the azimuth (in degrees);
+	Correct the value with magnetic declination if defined. 
+	
+	@since v0.1;
+	@since v1.3.0 - integer math, always 0 - 359.
+	@return int azimuth
+**/
+int QMC5883LCompass::getAzimuth(){
+	return getAzimuthCentidegrees() / 100;
+}
+
+
+/**
+	GET AZIMUTH IN CENTIDEGREES
+	Calculate the azimuth in hundredths of a degree (0 - 35999), corrected with the magnetic
+	declination if defined. @see _atan2() for accuracy and cost. The result is kept until the
+	next sample, so asking again for the same sample costs nothing.
+	
+	@since v1.3.0
+	@return uint16_t azimuth
+**/
+uint16_t QMC5883LCompass::getAzimuthCentidegrees(){
+	if ( !(_cached & QMC5883L_CACHE_AZIMUTH) ) {
+		QMC5883L_PROBE_START(start);
+		_cachedAzimuth = _heading( getY(), getX() );
+		_cached |= QMC5883L_CACHE_AZIMUTH;
+		QMC5883L_PROBE_STOP(azimuth, start, true);
+	}
+	return _cachedAzimuth;
+}
+
+
+/**
+	GET TILT COMPENSATED AZIMUTH
+	Calculate the azimuth (in degrees) of a sensor that is not held level. Pass the gravity
+	vector from an accelerometer at rest, in any unit, turned into the axes of the compass:
+	a level sensor with its top up reads (0, 0, +1g).
+	
+	@since v1.3.0
+	@return int azimuth, 0 - 359
+**/
+int QMC5883LCompass::getTiltCompensatedAzimuth(int ax, int ay, int az){
+	return getTiltCompensatedAzimuthCentidegrees(ax, ay, az) / 100;
+}
+
+
+/**
+	GET TILT COMPENSATED AZIMUTH IN CENTIDEGREES
+	Calculate the azimuth in hundredths of a degree (0 - 35999) of a tilted sensor,
+	corrected with the magnetic declination if defined. @see getTiltCompensatedAzimuth().
+	
+	The field is projected onto the horizontal plane with integer math: gravity is scaled to
+	a unit vector in Q12 with one integer square root, then the heading is the angle between
+	the projected field and the projected X axis, found with the same _atan2() as the level
+	azimuth. That is a handful of 32 bit multiplies on top of getAzimuthCentidegrees(), no
+	float and no trig functions. With no gravity (a zero vector) the level azimuth is returned.
+	
+	@since v1.3.0
+	@return uint16_t azimuth
+**/
+uint16_t QMC5883LCompass::getTiltCompensatedAzimuthCentidegrees(int ax, int ay, int az){
+	long g[3] = {ax, ay, az};
+	while ( labs(g[0]) > 0x7FFF || labs(g[1]) > 0x7FFF || labs(g[2]) > 0x7FFF ) {
+		g[0] /= 2;
+		g[1] /= 2;
+		g[2] /= 2;
+	}
+	uint16_t norm = _isqrt( (uint32_t)(g[0] * g[0]) + (uint32_t)(g[1] * g[1]) + (uint32_t)(g[2] * g[2]) );
+	if ( norm == 0 ) {
+		return getAzimuthCentidegrees();
+	}
+	
+	QMC5883L_PROBE_START(start);
+	for ( byte i = 0; i < 3; i++ ) {
+		g[i] = ( g[i] * 4096 ) / norm;
+	}
+	long mx = getX();
+	long my = getY();
+	long mz = getZ();
+	
+	// East is gravity x field, north the field minus its vertical part, both scaled by 4096.
+	long dot = ( mx * g[0] + my * g[1] + mz * g[2] ) / 4096;
+	long east = my * g[2] - mz * g[1];
+	long north = mx * 4096 - g[0] * dot;
+	uint16_t heading = _heading( east, north );
+	QMC5883L_PROBE_STOP(azimuth, start, true);
+	return heading;
+}
+
+
+/**
+	HEADING
+	Turn a horizontal field vector into an azimuth in hundredths of a degree (0 - 35999),
+	corrected with the magnetic declination.
+	
+	@since v1.3.0
+	@return uint16_t azimuth
+**/
+uint16_t QMC5883LCompass::_heading(long y, long x){
+	long heading = (long)_atan2( y, x ) + _declination;
+	if ( heading < 0 ) {
+		heading += 36000;
+	} else if ( heading >= 36000 ) {
+		heading -= 36000;
+	}
+	return heading;
+}
+
+
+/**
+	INTEGER SQUARE ROOT
+	Bit by bit square root, 16 rounds of shifts and adds.
+	
+	@since v1.3.0
+	@return uint16_t square root rounded down
+**/
+uint16_t QMC5883LCompass::_isqrt(uint32_t v){
+	uint32_t root = 0;
+	uint32_t bit = 1UL << 30;
+	while ( bit > v ) {
+		bit >>= 2;
+	}
+	while ( bit ) {
+		if ( v >= root + bit ) {
+			v -= root + bit;
+			root = ( root >> 1 ) + bit;
+		} else {
+			root >>= 1;
+		}
+		bit >>= 2;
+	}
+	return root;
+}
+
+
+/**
+	ATAN2
+	Integer atan2 in hundredths of a degree (0 - 35999).
+	
+	The angle is reduced to the first octant, where atan(min / max) is looked up in a 65 entry
+	table (in millidegrees) with linear interpolation, and then mirrored back.
+	
+	Worst-case error against a double precision atan2 is 0.01 degree (checked over every
+	octant ratio and a sweep of int16 vectors). The cost is one 32 bit division, one small
+	multiply and two table reads, against a soft-float atan2, a float multiply and the int /
+	float conversions for the code it replaces. The speedup has not been measured on a board.
+	Going by the usual cost of these operations on AVR, expect it to be several times faster
+	there. Run the benchmark example to measure both on your board.
+	
+	@since v1.3.0
+	@return uint16_t angle
+**/
+static const uint16_t _atanTable[65] PROGMEM = {
+	0, 895, 1790, 2684, 3576, 4467, 5356, 6242,
+	7125, 8005, 8881, 9752, 10620, 11482, 12339, 13191,
+	14036, 14876, 15709, 16535, 17354, 18166, 18970, 19767,
+	20556, 21337, 22109, 22874, 23629, 24376, 25115, 25844,
+	26565, 27277, 27979, 28673, 29358, 30033, 30700, 31357,
+	32005, 32645, 33275, 33896, 34509, 35112, 35707, 36293,
+	36870, 37439, 37999, 38550, 39094, 39629, 40156, 40675,
+	41186, 41689, 42184, 42672, 43152, 43625, 44091, 44549,
+	45000,
+};
+
+uint16_t QMC5883LCompass::_atan2(long y, long x){
+	unsigned long ax = labs(x);
+	unsigned long ay = labs(y);
+	if ( ax == 0 && ay == 0 ) {
+		return 0;
+	}
+	
+	// Keep the ratio below within 32 bits.
+	while ( ax > 0xFFFF || ay > 0xFFFF ) {
+		ax >>= 1;
+		ay >>= 1;
+	}
+	
+	bool steep = ( ay > ax );
+	unsigned long r = steep ? (ax << 15) / ay : (ay << 15) / ax;
+	
+	byte i = r >> 9;
+	uint16_t a = pgm_read_word(&_atanTable[i]);
+	if ( i < 64 ) {
+		uint16_t b = pgm_read_word(&_atanTable[i + 1]);
+		a += ( (unsigned long)(b - a) * (r & 0x1FF) + 0x100 ) >> 9;
+	}
+	
+	long angle = (a + 5) / 10;
+	if ( steep ) {
+		angle = 9000 - angle;
+	}
+	if ( x < 0 ) {
+		angle = 18000 - angle;
+	}
+	if ( y < 0 ) {
+		angle = 36000 - angle;
+	}
+	return ( angle >= 36000 ) ? angle - 36000 : angle;
+}
+
+
+/**
+	GET BEARING
+	Divide the 360 degree circle into 16 equal parts and then return the a value of 0-15
+	based on where the azimuth is currently pointing.
 
  
+	@since v1.3.0 - integer math, sectors are centered on their direction (0 = 348.75 - 11.25).
 	@since v1.2.1 - function takes into account negative azimuth values. Credit: https://github.com/prospark
 	@since v1.0.1 - function now requires azimuth parameter.
 	@since v0.2.0 - initial creation
@@ -428,14 +2892,198 @@ int QMC5883LCompass::getAzimuth(){
 	@return byte direction of bearing
 */
 byte QMC5883LCompass::getBearing(int azimuth){
-	unsigned long a = ( azimuth > -0.5 ) ? azimuth / 22.5 : (azimuth+360)/22.5;
-	unsigned long r = a - (int)a;
-	byte sexdec = 0;	
-	sexdec = ( r >= .5 ) ? ceil(a) : floor(a);
-	return sexdec;
+	return getBearing(azimuth, 16);
+}
+
+
+/**
+	GET BEARING OF THE CURRENT SAMPLE
+	Same as getBearing(getAzimuth()), worked out once per sample.
+	
+	@since v1.3.0
+	@return byte direction of bearing, 0 - 15
+**/
+byte QMC5883LCompass::getBearing(){
+	if ( !(_cached & QMC5883L_CACHE_BEARING) ) {
+		_cachedBearing = getBearing(getAzimuth(), 16);
+		_cached |= QMC5883L_CACHE_BEARING;
+	}
+	return _cachedBearing;
+}
+
+
+/**
+	GET BEARING WITH SECTORS
+	Divide the 360 degree circle into 4, 8, 16 or 32 equal parts and then return a value of
+	0 - (points - 1) based on where the azimuth is currently pointing. Sector 0 is centered on
+	North and the sectors count clockwise.
+	
+	@since v1.3.0
+	@return byte direction of bearing
+*/
+byte QMC5883LCompass::getBearing(int azimuth, byte points){
+	if ( points == 0 || points > 32 ) {
+		points = 16;
+	}
+	int a = azimuth % 360;
+	if ( a < 0 ) {
+		a += 360;
+	}
+	return ( (unsigned int)a * points + 180 ) / 360 % points;
 }
 
 
+/**
+	ON HEADING CHANGE
+	Call a function whenever the azimuth has moved delta degrees or more from the azimuth
+	it was last called with, and once for the first sample. The function gets the new azimuth
+	(0 - 359) and runs inside the read that brought the change, e.g. read() or readIfReady().
+	Pass nullptr to stop.
+	
+	The azimuth is only calculated when the calibrated X or Y value has changed, so a loop that
+	keeps reading a steady sensor doesn't pay for it.
+	
+	@since v1.3.0
+**/
+void QMC5883LCompass::onHeadingChange(int delta, QMC5883LHeadingCallback callback){
+	_headingCallback = callback;
+	_headingDelta = abs(delta);
+	_headingReported = 0xFFFF;
+}
+
+
+/**
+	ON BEARING CHANGE
+	Call a function whenever the bearing changes, and once for the first sample. The function
+	gets the new bearing (0 - points - 1, @see getBearing()) and the azimuth, so it can call
+	getDirection() as well. Pass nullptr to stop.
+	
+	To keep a heading right on the edge of two sectors from flipping back and forth, the
+	bearing only changes once the azimuth is hysteresis degrees past the edge.
+	
+	@since v1.3.0
+**/
+void QMC5883LCompass::onBearingChange(QMC5883LBearingCallback callback, byte points, byte hysteresis){
+	_bearingCallback = callback;
+	_bearingPoints = ( points == 0 || points > 32 ) ? 16 : points;
+	_bearingHysteresis = hysteresis;
+	_bearing = 0xFF;
+}
+
+
+/**
+	GET HEADING RATE
+	How fast the azimuth turns in degrees per second, positive clockwise. A moving average over
+	about 4 samples, based on the sample timestamps. The rate is tracked from the first call
+	on, 0 until two samples have been read after that.
+	
+	@since v1.3.0
+	@return float heading rate
+**/
+float QMC5883LCompass::getHeadingRate(){
+	_trackRate = true;
+	return ( _trackCount < 2 ) ? 0 : _headingRate / 100.0f;
+}
+
+
+/**
+	WRAP ANGLE
+	Fold a difference of two angles in hundredths of a degree into -18000 - 18000.
+	
+	@since v1.3.0
+	@return long angle difference
+**/
+static long _wrapAngle(long d){
+	if ( d > 18000 ) {
+		return d - 36000;
+	}
+	if ( d < -18000 ) {
+		return d + 36000;
+	}
+	return d;
+}
+
+
+/**
+	TRACK HEADING
+	Update the heading rate and fire the change callbacks after a new sample.
+	
+	@since v1.3.0
+**/
+void QMC5883LCompass::_trackHeading(){
+	int x = getX();
+	int y = getY();
+	bool changed = ( _trackCount == 0 || x != _trackX || y != _trackY );
+	uint16_t azimuth = changed ? getAzimuthCentidegrees() : _trackAzimuth;
+	_trackX = x;
+	_trackY = y;
+	
+	// Centidegrees per second: 1000000 = 62500 * 16, so d * 62500 fits in 32 bits.
+	uint32_t dt = ( _timestamp - _trackTime ) >> 4;
+	if ( _trackCount > 0 && dt > 0 ) {
+		long rate = _wrapAngle( (long)azimuth - _trackAzimuth ) * 62500L / (long)dt;
+		_headingRate = ( _trackCount == 1 ) ? rate : _headingRate + ( rate - _headingRate ) / 4;
+	}
+	if ( _trackCount < 2 ) {
+		_trackCount++;
+	}
+	_trackAzimuth = azimuth;
+	_trackTime = _timestamp;
+	
+	if ( !changed ) {
+		return;
+	}
+	
+	if ( _headingCallback ) {
+		if ( _headingReported == 0xFFFF || labs( _wrapAngle( (long)azimuth - _headingReported ) ) >= _headingDelta * 100L ) {
+			_headingReported = azimuth;
+			_headingCallback( azimuth / 100 );
+		}
+	}
+	
+	if ( _bearingCallback ) {
+		byte points = _bearingPoints;
+		// From whole degrees like getBearing(azimuth, points), so both agree.
+		byte bearing = getBearing(azimuth / 100, points);
+		if ( _bearing != 0xFF && bearing != _bearing ) {
+			// Distance from the center of the current sector, against half a sector plus hysteresis.
+			long d = labs( _wrapAngle( (long)azimuth - (long)_bearing * 36000 / points ) );
+			if ( d <= 18000L / points + _bearingHysteresis * 100L ) {
+				return;
+			}
+		}
+		if ( bearing != _bearing ) {
+			_bearing = bearing;
+			_bearingCallback( bearing, azimuth / 100 );
+		}
+	}
+}
+
+
+/**
+	BEARING NAMES
+	Text representation of the 16 bearings, shared by all compass instances and kept in flash.
+*/
+static const char _bearings[16][3] PROGMEM = {
+	{' ', ' ', 'N'},
+	{'N', 'N', 'E'},
+	{' ', 'N', 'E'},
+	{'E', 'N', 'E'},
+	{' ', ' ', 'E'},
+	{'E', 'S', 'E'},
+	{' ', 'S', 'E'},
+	{'S', 'S', 'E'},
+	{' ', ' ', 'S'},
+	{'S', 'S', 'W'},
+	{' ', 'S', 'W'},
+	{'W', 'S', 'W'},
+	{' ', ' ', 'W'},
+	{'W', 'N', 'W'},
+	{' ', 'N', 'W'},
+	{'N', 'N', 'W'},
+};
+
+
 /**
 	This will take the location of the azimuth as calculated in getBearing() and then
 	produce an array of chars as a text representation of the direction.
@@ -461,8 +3109,37 @@ byte QMC5883LCompass::getBearing(int azimuth){
 	@since v0.2.0 - initial creation
 */
 void QMC5883LCompass::getDirection(char* myArray, int azimuth){
-	int d = getBearing(azimuth);
-	myArray[0] = _bearings[d][0];
-	myArray[1] = _bearings[d][1];
-	myArray[2] = _bearings[d][2];
+	getDirection(myArray, azimuth, 16);
+}
+
+
+/**
+	GET DIRECTION OF THE CURRENT SAMPLE
+	Same as getDirection(myArray, getAzimuth()), using the bearing worked out once per sample.
+	
+	@since v1.3.0
+*/
+void QMC5883LCompass::getDirection(char* myArray){
+	byte d = getBearing();
+	myArray[0] = pgm_read_byte(&_bearings[d][0]);
+	myArray[1] = pgm_read_byte(&_bearings[d][1]);
+	myArray[2] = pgm_read_byte(&_bearings[d][2]);
+}
+
+
+/**
+	GET DIRECTION WITH SECTORS
+	Same as getDirection(), but only names 4 (N, E, S, W), 8 (N, NE, E, ...) or 16 directions.
+	32 points are named like 16 points, since their names don't fit in 3 chars.
+	
+	@since v1.3.0
+*/
+void QMC5883LCompass::getDirection(char* myArray, int azimuth, byte points){
+	if ( points != 4 && points != 8 ) {
+		points = 16;
+	}
+	byte d = getBearing(azimuth, points) * (16 / points);
+	myArray[0] = pgm_read_byte(&_bearings[d][0]);
+	myArray[1] = pgm_read_byte(&_bearings[d][1]);
+	myArray[2] = pgm_read_byte(&_bearings[d][2]);
 }
@@ -4,71 +4,528 @@
 #include "Arduino.h"
 #include "Wire.h"
 
+/*
+===============================================================================================================
+BUILD OPTIONS
+Features you don't use can be compiled out to save RAM and flash, and to drop their checks from the read
+path. Set these in your build flags (e.g. build_flags = -DQMC5883L_ENABLE_SMOOTHING=0 in PlatformIO), or
+change the defaults below.
+
+Don't define them in your sketch before the #include: the library is compiled on its own with the values
+below, and most options change the layout of QMC5883LCompass. A sketch and library that disagree on the layout
+would corrupt memory, so such a sketch fails to link instead, @see QMC5883L_OPTIONS. The options have to be
+plain numbers for this.
+===============================================================================================================
+*/
+
+/**
+	SMOOTHING
+	setSmoothing(), setFilter() and all filter state. 0 = compiled out.
+**/
+#ifndef QMC5883L_ENABLE_SMOOTHING
+#define QMC5883L_ENABLE_SMOOTHING 1
+#endif
+
+/**
+	SMOOTHING STEPS
+	Largest number of steps setSmoothing() accepts. The smoothing history is allocated for this
+	many steps, the time per reading does not depend on it. Up to 255, 0 compiles the rolling
+	average out but keeps the other filters.
+**/
+#ifndef QMC5883L_SMOOTH_MAX_STEPS
+#define QMC5883L_SMOOTH_MAX_STEPS 10
+#endif
+
+/**
+	CALIBRATION
+	calibrate(), the calibration setters / getters and the calibration state. 0 = compiled out,
+	getX() etc. return raw values.
+**/
+#ifndef QMC5883L_ENABLE_CALIBRATION
+#define QMC5883L_ENABLE_CALIBRATION 1
+#endif
+
+/**
+	CALIBRATION MATRIX
+	setCalibrationMatrix(), fitCalibrationMatrix() and the 3x3 soft-iron matrix. 0 = compiled out.
+	Needs QMC5883L_ENABLE_CALIBRATION.
+**/
+#ifndef QMC5883L_ENABLE_CALIBRATION_MATRIX
+#define QMC5883L_ENABLE_CALIBRATION_MATRIX QMC5883L_ENABLE_CALIBRATION
+#endif
+
+/**
+	CALIBRATION COVERAGE
+	Coverage in percent at which startCalibration() applies the new calibration, @see
+	getCalibrationCoverage().
+**/
+#ifndef QMC5883L_CALIBRATION_COVERAGE
+#define QMC5883L_CALIBRATION_COVERAGE 80
+#endif
+
+/**
+	INTERRUPT MODE
+	enableInterrupt(), service(), readSamples() and the sample ring. 0 = compiled out.
+**/
+#ifndef QMC5883L_ENABLE_INTERRUPT
+#define QMC5883L_ENABLE_INTERRUPT 1
+#endif
+
+/**
+	TIMING
+	Measured sample rate and jitter, @see getSampleRate(). 0 = compiled out.
+**/
+#ifndef QMC5883L_ENABLE_TIMING
+#define QMC5883L_ENABLE_TIMING 1
+#endif
+
+/**
+	DISTURBANCE DETECTION
+	setDisturbanceDetection() and the detector state. 0 = compiled out.
+**/
+#ifndef QMC5883L_ENABLE_DISTURBANCE
+#define QMC5883L_ENABLE_DISTURBANCE 1
+#endif
+
+/**
+	INSTRUMENTATION
+	Time the I2C data transaction, calibration, smoothing and azimuth math of every sample,
+	@see getStats(). Adds two micros() calls per section. 0 = compiled out.
+**/
+#ifndef QMC5883L_ENABLE_INSTRUMENTATION
+#define QMC5883L_ENABLE_INSTRUMENTATION 0
+#endif
+
+/**
+	TEMPERATURE STEP
+	Change of the raw temperature (100 per degree C) after which the temperature compensated
+	offsets are recomputed, @see setTemperatureCompensation().
+**/
+#ifndef QMC5883L_TEMPERATURE_STEP
+#define QMC5883L_TEMPERATURE_STEP 25
+#endif
+
+/**
+	OPTIONS
+	QMC5883LCompass is declared in an inline namespace named after the build options that change
+	its layout, e.g. QMC5883L_options_s1_n10_c1_m1_i1_t1_p0_d1 (smoothing, steps, calibration,
+	matrix, interrupt, timing, instrumentation, disturbance). Sketches use the class as
+	before, but every member function is linked by that name. A sketch built with other options
+	than the library gets undefined references into another namespace.
+**/
+#define QMC5883L_OPTIONS_NAME(s, n, c, m, i, t, p, d) \
+	QMC5883L_options_s##s##_n##n##_c##c##_m##m##_i##i##_t##t##_p##p##_d##d
+#define QMC5883L_OPTIONS_EXPAND(...) QMC5883L_OPTIONS_NAME(__VA_ARGS__)
+#define QMC5883L_OPTIONS QMC5883L_OPTIONS_EXPAND(QMC5883L_ENABLE_SMOOTHING, QMC5883L_SMOOTH_MAX_STEPS, \
+	QMC5883L_ENABLE_CALIBRATION, QMC5883L_ENABLE_CALIBRATION_MATRIX, QMC5883L_ENABLE_INTERRUPT, \
+	QMC5883L_ENABLE_TIMING, QMC5883L_ENABLE_INSTRUMENTATION, QMC5883L_ENABLE_DISTURBANCE)
+
+/**
+	CALIBRATION SIZE
+	Size in bytes of the calibration data written by saveCalibration().
+**/
+#define QMC5883L_CALIBRATION_SIZE 82
+
+/**
+	STATUS
+	Status bits returned by read() and getStatus(). DRDY, OVL and DOR are the bits of the
+	STATUS register (0x06) of the chip.
+**/
+#define QMC5883L_STATUS_DRDY		0x01
+#define QMC5883L_STATUS_OVL			0x02
+#define QMC5883L_STATUS_DOR			0x04
+#define QMC5883L_STATUS_I2C_ERROR	0x80
+
+/**
+	FILTER
+	Smoothing filters, @see setFilter().
+**/
+enum QMC5883LFilter : uint8_t {
+	QMC5883L_FILTER_NONE = 0,
+	QMC5883L_FILTER_BOXCAR,
+	QMC5883L_FILTER_EMA,
+	QMC5883L_FILTER_LOWPASS,
+	QMC5883L_FILTER_MEDIAN3
+};
+
+/**
+	SAMPLE
+	A single raw measurement as read from the chip.
+	
+	x, y, z	Raw axis values.
+	status	STATUS register (0x06) read in the same burst.
+	t		micros() timestamp of the measurement. With the DRDY interrupt this is the
+			time of the interrupt, otherwise the time the read that found it started.
+	temperature	Raw chip temperature read in the same burst when streaming with temperature,
+			otherwise the last one read. Temperature compensation uses it, so samples
+			drained later get the correction of their own temperature.
+**/
+struct QMC5883LSample {
+	int16_t x;
+	int16_t y;
+	int16_t z;
+	uint8_t status;
+	uint32_t t;
+	int16_t temperature;
+} __attribute__((packed));
+
+/**
+	COUNTERS
+	Running counters, @see getCounters().
+	
+	reads		Samples read.
+	i2cErrors	Failed I2C transactions.
+	overflows	Samples with an axis out of range (OVL). These are not used.
+	skipped		Measurements that were never read, because they were overwritten on the chip
+				(DOR) or the interrupt mode sample ring was full.
+**/
+struct QMC5883LCounters {
+	uint32_t reads;
+	uint32_t i2cErrors;
+	uint32_t overflows;
+	uint32_t skipped;
+};
+
+/**
+	PROBE
+	Durations of one instrumented section in us, @see getStats().
+	
+	count	Times the section ran.
+	errors	Runs that failed, e.g. the chip did not answer.
+	min		Shortest run, 0 until the first run.
+	max		Longest run.
+	avg		Average run.
+	total	Sum of all runs.
+**/
+struct QMC5883LProbe {
+	uint32_t count;
+	uint32_t errors;
+	uint32_t min;
+	uint32_t max;
+	uint32_t avg;
+	uint32_t total;
+};
+
+/**
+	STATS
+	Instrumented sections, @see getStats().
+	
+	i2c			Data burst transaction of read(), readIfReady(), service() etc.
+	calibration	Applying the calibration.
+	smoothing	The smoothing filter.
+	azimuth		getAzimuth(), getTiltCompensatedAzimuth() etc.
+**/
+struct QMC5883LStats {
+	QMC5883LProbe i2c;
+	QMC5883LProbe calibration;
+	QMC5883LProbe smoothing;
+	QMC5883LProbe azimuth;
+};
+
+/**
+	CALLBACKS
+	Called from the read that brought the change, @see onHeadingChange() and onBearingChange().
+**/
+typedef void (*QMC5883LHeadingCallback)(int azimuth);
+typedef void (*QMC5883LBearingCallback)(byte bearing, int azimuth);
+
+template <typename T> class QMC5883LMahony;
+
+inline namespace QMC5883L_OPTIONS {
 
 class QMC5883LCompass{
 	
+	// The orientation filter shares the heading math and the output data rate.
+	template <typename T> friend class ::QMC5883LMahony;
+	
   public:
     QMC5883LCompass();
 	void init();
+	void begin(TwoWire& wire, byte addr = 0x0D);
+	void setMux(byte muxAddr, byte channel);
     void setADDR(byte b);
     void setMode(byte mode, byte odr, byte rng, byte osr);
+	void setAutoRange(bool enable);
+#if QMC5883L_ENABLE_DISTURBANCE
+	void setDisturbanceDetection(bool enable, byte threshold = 10, bool freeze = true);
+	bool isDisturbed();
+	byte getDisturbance();
+#endif
+	void standby();
+	void wake();
+	static uint32_t estimateEnergy(byte osr, byte samples = 1);
+	static uint16_t estimateReadTime(byte odr, byte samples = 1);
+	void setStreaming(bool enable, bool temperature = false);
 	void setMagneticDeclination(int degrees, uint8_t minutes);
+#if QMC5883L_ENABLE_SMOOTHING
+#if QMC5883L_SMOOTH_MAX_STEPS
 	void setSmoothing(byte steps, bool adv);
+#endif
+	void setFilter(QMC5883LFilter filter, float param = 0);
+#endif
+#if QMC5883L_ENABLE_CALIBRATION
 	void calibrate();
+	void startCalibration(bool autoApply = true);
+	bool stopCalibration(bool apply = false);
+	bool isCalibrating();
+	byte getCalibrationCoverage();
 	void setCalibration(int x_min, int x_max, int y_min, int y_max, int z_min, int z_max);
 	void setCalibrationOffsets(float x_offset, float y_offset, float z_offset);
 	void setCalibrationScales(float x_scale, float y_scale, float z_scale);
     float getCalibrationOffset(uint8_t index);
 	float getCalibrationScale(uint8_t index);
+#if QMC5883L_ENABLE_CALIBRATION_MATRIX
+	void setCalibrationMatrix(const float matrix[3][3]);
+	float getCalibrationMatrix(uint8_t row, uint8_t col);
+	bool fitCalibrationMatrix(const int16_t samples[][3], uint16_t count);
+#endif
+	void setTemperatureCompensation(float x_slope, float y_slope, float z_slope, int reference);
+	float getTemperatureSlope(uint8_t index);
+	int getTemperatureReference();
 	void clearCalibration();
+	// Call both after init() / begin() and setMode(), offsets are stored and converted for the range set then.
+	size_t saveCalibration(uint8_t* buffer, size_t size);
+	bool loadCalibration(const uint8_t* buffer, size_t size);
+#endif
+	static uint16_t crc16(const uint8_t* data, size_t length, uint16_t crc = 0xFFFF);
 	void setReset();
-    void read();
+	bool verifyConfig();
+	byte getMode();
+	byte getODR();
+	byte getRange();
+	byte getOSR();
+    byte read();
+	static void readAll(QMC5883LCompass* compasses[], uint8_t count);
+	bool startRead();
+	bool pollRead();
+	bool finishRead();
+	bool available();
+	bool readIfReady();
+	size_t readBurst(QMC5883LSample* samples, size_t count, unsigned long timeout = 1000);
+	byte readOnce(byte samples = 1, unsigned long timeout = 1000);
+#if QMC5883L_ENABLE_INTERRUPT
+	// The sample ring is the caller's array, so it takes no RAM unless interrupt mode is used.
+	template <uint8_t N> bool enableInterrupt(byte pin, QMC5883LSample (&ring)[N]) {
+		static_assert(N >= 2 && N <= 128 && (N & (N - 1)) == 0, "The sample ring size must be a power of two, 2 - 128");
+		return _enableInterrupt(pin, ring, N);
+	}
+	void disableInterrupt();
+	bool service();
+	uint8_t samplesAvailable();
+	uint8_t readSamples(QMC5883LSample* samples, uint8_t max);
+#endif
 	int getX();
 	int getY();
 	int getZ();
+	void getXYZ(int16_t& x, int16_t& y, int16_t& z);
+	int getMilliGauss(uint8_t index);
+	byte getStatus();
+	uint32_t getTimestamp();
+	uint32_t getSampleId();
+#if QMC5883L_ENABLE_TIMING
+	float getSampleRate();
+	uint32_t getSampleInterval();
+	uint32_t getSampleJitter();
+#endif
+	QMC5883LCounters getCounters();
+	void clearCounters();
+#if QMC5883L_ENABLE_INSTRUMENTATION
+	QMC5883LStats getStats();
+	void clearStats();
+#endif
+	int getTemperature();
 	int getAzimuth();
+	uint16_t getAzimuthCentidegrees();
+	int getTiltCompensatedAzimuth(int ax, int ay, int az);
+	uint16_t getTiltCompensatedAzimuthCentidegrees(int ax, int ay, int az);
+	byte getBearing();
 	byte getBearing(int azimuth);
+	byte getBearing(int azimuth, byte points);
+	void getDirection(char* myArray);
 	void getDirection(char* myArray, int azimuth);
+	void getDirection(char* myArray, int azimuth, byte points);
+	void onHeadingChange(int delta, QMC5883LHeadingCallback callback);
+	void onBearingChange(QMC5883LBearingCallback callback, byte points = 16, byte hysteresis = 2);
+	float getHeadingRate();
 
   private:
-    void _writeReg(byte reg,byte val);
+    bool _writeReg(byte reg,byte val);
+	void _select();
+	byte _readReg(byte reg);
+	bool _readSample(QMC5883LSample& s);
+	void _unpackSample(QMC5883LSample& s);
+	bool _setPointer(bool stop);
+	bool _requestSample();
+	byte _burstLength();
+	byte _streamMode = 0;
+	bool _pointerParked = false;
+	int _vTemp = 0;
+	byte _readState = 0;
+	void _processSample(const QMC5883LSample& s);
+	bool _readIfReady(QMC5883LSample& s);
+	bool _waitSample(QMC5883LSample& s, uint32_t notBefore, unsigned long timeout);
 	int _get(int index);
-	float _magneticDeclinationDegrees = 0;
-	bool _smoothUse = false;
-	byte _smoothSteps = 5;
-	bool _smoothAdvanced = false;
+	int _declination = 0;
+	static uint16_t _atan2(long y, long x);
+	static uint16_t _isqrt(uint32_t v);
+	uint16_t _heading(long y, long x);
     byte _ADDR = 0x0D;
+	TwoWire* _wire = &Wire;
+	byte _muxAddr = 0;
+	byte _muxChannel = 0;
+	byte _muxHold = 0;
+	bool _muxSelected = false;
+	
+	// Keeps the multiplexer channel selected until the end of a public call, @see _select().
+	struct MuxScope {
+		QMC5883LCompass& c;
+		MuxScope(QMC5883LCompass& compass) : c(compass) { c._muxHold++; }
+		~MuxScope() { if ( --c._muxHold == 0 ) { c._muxSelected = false; } }
+	};
 	int _vRaw[3] = {0,0,0};
-	int _vHistory[10][3];
-	int _vScan = 0;
-	long _vTotals[3] = {0,0,0};
+#if QMC5883L_ENABLE_SMOOTHING
+	bool _smoothUse = false;
+	byte _vCount = 0;
 	int _vSmooth[3] = {0,0,0};
 	void _smoothing();
+	void _smoothIIR();
+	void _smoothMedian();
+	void _updateFilter();
+	void _resetSmoothing();
+	QMC5883LFilter _filter = QMC5883L_FILTER_NONE;
+	float _filterParam = 0;
+	long _filterAlpha = 0;
+	union {
+		long _vFilter[3];
+		int _vPrev[2][3];
+	};
+#if QMC5883L_SMOOTH_MAX_STEPS
+	byte _smoothSteps = 5;
+	bool _smoothAdvanced = false;
+	int _vHistory[QMC5883L_SMOOTH_MAX_STEPS][3];
+	byte _vScan = 0;
+	long _vTotals[3] = {0,0,0};
+	byte _vMaxQ[3][QMC5883L_SMOOTH_MAX_STEPS];
+	byte _vMinQ[3][QMC5883L_SMOOTH_MAX_STEPS];
+	byte _vMaxHead[3] = {0,0,0};
+	byte _vMaxLen[3] = {0,0,0};
+	byte _vMinHead[3] = {0,0,0};
+	byte _vMinLen[3] = {0,0,0};
+	void _smoothBoxcar();
+	byte _smoothNext(byte i);
+	byte _smoothBack(byte head, unsigned int len);
+#endif
+#endif
+#if QMC5883L_ENABLE_CALIBRATION
 	float _offset[3] = {0.,0.,0.};
 	float _scale[3] = {1.,1.,1.};
+	int16_t _calOffset[3] = {0,0,0};
+	int16_t _calScale[3] = {16384,16384,16384};
+	byte _calShift[3] = {14,14,14};
+	long _calBias[3] = {0,0,0};
+	void _updateCalibration();
+	float _tcSlope[3] = {0.,0.,0.};
+	int _tcRef = 0;
+	int _tcTemp = 0;
+	bool _tcUse = false;
+	bool _calRunning = false;
+	bool _calAuto = true;
+	int16_t _calMin[3] = {0,0,0};
+	int16_t _calMax[3] = {0,0,0};
+	uint32_t _calBins = 0;
+	uint16_t _calStable = 0;
+	uint16_t _calSamples = 0;
+	void _calibrationStep();
+#endif
+#if QMC5883L_ENABLE_CALIBRATION_MATRIX
+	float _matrix[3][3] = {{1.,0.,0.},{0.,1.,0.},{0.,0.,1.}};
+	int16_t _calMatrix[3][3];
+	bool _calMatrixUse = false;
+#endif
 	int _vCalibrated[3];
+	byte _status = 0;
+	uint32_t _timestamp = 0;
+	uint32_t _sampleId = 0;
+	byte _cached = 0;
+	uint16_t _cachedAzimuth = 0;
+	byte _cachedBearing = 0;
+	uint32_t _readTime = 0;
+#if QMC5883L_ENABLE_TIMING
+	byte _timingCount = 0;
+	long _interval = 0;
+	long _jitter = 0;
+	void _updateTiming(uint32_t t);
+#endif
+	QMC5883LCounters _counters = {0, 0, 0, 0};
+#if QMC5883L_ENABLE_INSTRUMENTATION
+	QMC5883LStats _stats = {};
+	static void _probe(QMC5883LProbe& probe, uint32_t start, bool ok);
+#endif
 	void _applyCalibration();
-	const char _bearings[16][3] =  {
-		{' ', ' ', 'N'},
-		{'N', 'N', 'E'},
-		{' ', 'N', 'E'},
-		{'E', 'N', 'E'},
-		{' ', ' ', 'E'},
-		{'E', 'S', 'E'},
-		{' ', 'S', 'E'},
-		{'S', 'S', 'E'},
-		{' ', ' ', 'S'},
-		{'S', 'S', 'W'},
-		{' ', 'S', 'W'},
-		{'W', 'S', 'W'},
-		{' ', ' ', 'W'},
-		{'W', 'N', 'W'},
-		{' ', 'N', 'W'},
-		{'N', 'N', 'W'},
-	};
+	byte _ctrl1 = 0x00;
+	byte _ctrl2 = 0x40;
+	byte _period = 0x00;
+	byte _shadowValid = 0;
+	bool _updateReg(byte reg, byte val);
+	void _restoreConfig();
+	int _odrHz();
+	bool _autoRange = false;
+	bool _rangeSkip = false;
+	bool _rangeSeen = false;
+	byte _rangeLow = 0;
+	uint32_t _rangeTime = 0;
+	uint32_t _rangeLowTime = 0;
+	bool _autoRangeStep(const QMC5883LSample& s);
+	void _switchRange(byte rng);
+	QMC5883LHeadingCallback _headingCallback = nullptr;
+	int _headingDelta = 0;
+	uint16_t _headingReported = 0xFFFF;
+	QMC5883LBearingCallback _bearingCallback = nullptr;
+	byte _bearingPoints = 16;
+	byte _bearingHysteresis = 2;
+	byte _bearing = 0xFF;
+	bool _trackRate = false;
+	byte _trackCount = 0;
+	int _trackX = 0;
+	int _trackY = 0;
+	uint16_t _trackAzimuth = 0;
+	uint32_t _trackTime = 0;
+	long _headingRate = 0;
+	void _trackHeading();
+#if QMC5883L_ENABLE_DISTURBANCE
+	bool _distUse = false;
+	bool _distFreeze = true;
+	bool _disturbed = false;
+	byte _distThreshold = 10;
+	byte _distCount = 0;
+	byte _distScore = 0;
+	long _distRef = 0;
+	long _distMean = 0;
+	long _distDev = 0;
+	void _disturbanceStep();
+#endif
+#if QMC5883L_ENABLE_INTERRUPT
+	byte _intPin = 0xFF;
+	int8_t _intSlot = -1;
+	volatile bool _drdyFlag = false;
+	volatile uint32_t _drdyTime = 0;
+	QMC5883LSample* _ring = nullptr;
+	uint8_t _ringMask = 0;
+	volatile uint8_t _ringHead = 0;
+	volatile uint8_t _ringTail = 0;
+	bool _enableInterrupt(byte pin, QMC5883LSample* ring, uint8_t size);
+	void _onDataReady();
+	static QMC5883LCompass* _isrInstances[4];
+	static void _isr0();
+	static void _isr1();
+	static void _isr2();
+	static void _isr3();
+#endif
 	
 	
 	
 };
 
+}
+
 #endif
@@ -0,0 +1,395 @@
+/*
+===============================================================================================================
+QMC5883LCompass.h Library - Mahony Orientation Filter
+Learn more at [https://github.com/mprograms/QMC5883LCompass]
+
+Fuses the calibrated compass samples with a gyroscope and an accelerometer into an orientation quaternion
+and a tilt compensated heading, using the Mahony complementary filter (R. Mahony, T. Hamel, J. Pflimlin,
+"Nonlinear Complementary Filters on the Special Orthogonal Group", IEEE TAC 2008).
+
+The filter runs one fixed step per compass sample, so it updates at the output data rate. It keeps 7 values
+of state, never allocates and touches no table but the one of the heading math. Two variants:
+
+	QMC5883LMahonyFloat	float math, for boards with an FPU (ESP32, Cortex-M4F etc.).
+	QMC5883LMahonyFixed	Q16.16 fixed-point math, for boards without one (AVR, ESP8266, Cortex-M0).
+
+===============================================================================================================
+Release under the GNU General Public License v3
+[https://www.gnu.org/licenses/gpl-3.0.en.html]
+===============================================================================================================
+*/
+#ifndef QMC5883L_Mahony
+#define QMC5883L_Mahony
+
+#include "QMC5883LCompass.h"
+
+/**
+	Q16.16
+	Signed fixed-point number with 16 integer and 16 fraction bits, range -32768 - 32767.99998.
+	Build constants from float (they are folded at compile time), or from raw Q16.16 with fromRaw().
+**/
+struct QMC5883LQ16 {
+	int32_t v;
+	
+	QMC5883LQ16() : v(0) {}
+	constexpr QMC5883LQ16(float f) : v((int32_t)(f * 65536.0f + (f < 0 ? -0.5f : 0.5f))) {}
+	static QMC5883LQ16 fromRaw(int32_t raw) { QMC5883LQ16 q; q.v = raw; return q; }
+	float toFloat() const { return v / 65536.0f; }
+	
+	QMC5883LQ16 operator-() const { return fromRaw(-v); }
+	QMC5883LQ16 operator+(QMC5883LQ16 b) const { return fromRaw(v + b.v); }
+	QMC5883LQ16 operator-(QMC5883LQ16 b) const { return fromRaw(v - b.v); }
+	QMC5883LQ16 operator*(QMC5883LQ16 b) const { return fromRaw((int32_t)(((int64_t)v * b.v + 0x8000) >> 16)); }
+	QMC5883LQ16& operator+=(QMC5883LQ16 b) { v += b.v; return *this; }
+	QMC5883LQ16& operator-=(QMC5883LQ16 b) { v -= b.v; return *this; }
+	bool operator>(QMC5883LQ16 b) const { return v > b.v; }
+};
+
+
+template <typename T>
+class QMC5883LMahony {
+	
+  public:
+	QMC5883LMahony();
+	void begin(float sampleRate, float kp = 1.0f, float ki = 0.0f);
+	void begin(QMC5883LCompass& compass, float kp = 1.0f, float ki = 0.0f);
+	void setGains(float kp, float ki);
+	void reset();
+	void update(T gx, T gy, T gz, T ax, T ay, T az);
+	void update(T gx, T gy, T gz, T ax, T ay, T az, T mx, T my, T mz);
+	void getQuaternion(T& w, T& x, T& y, T& z);
+	int getHeading();
+	uint16_t getHeadingCentidegrees();
+	
+  private:
+	static bool _normalize(float& x, float& y, float& z);
+	static bool _normalize(QMC5883LQ16& x, QMC5883LQ16& y, QMC5883LQ16& z);
+	static float _invSqrt(float v);
+	static QMC5883LQ16 _invSqrt(QMC5883LQ16 v);
+	static long _toLong(float v);
+	static long _toLong(QMC5883LQ16 v);
+	static void _fromInt(float& out, int v);
+	static void _fromInt(QMC5883LQ16& out, int v);
+	
+	QMC5883LCompass* _compass = nullptr;
+	T _q[4];
+	T _eInt[3];
+	T _kp;
+	T _kpSettle;
+	T _ki;
+	T _dt;
+	T _halfDt;
+	uint16_t _rate;
+	uint16_t _settle;
+};
+
+typedef QMC5883LMahony<float> QMC5883LMahonyFloat;
+typedef QMC5883LMahony<QMC5883LQ16> QMC5883LMahonyFixed;
+
+
+template <typename T>
+QMC5883LMahony<T>::QMC5883LMahony() {
+	begin(200.0f);
+}
+
+
+/**
+	BEGIN
+	Set the sample rate in Hz and the gains. kp sets how fast the accelerometer and compass
+	pull the estimate back (higher follows them faster, lower trusts the gyro more), ki how
+	fast a constant gyro bias is removed, 0 turns that off.
+	
+	Pass the compass instead of a rate to take the rate from its output data rate, to read the
+	field from it in update() and to apply its magnetic declination to getHeading().
+	
+	@since v1.3.0
+**/
+template <typename T>
+void QMC5883LMahony<T>::begin(float sampleRate, float kp, float ki) {
+	_dt = T(1.0f / sampleRate);
+	_halfDt = T(0.5f / sampleRate);
+	_rate = sampleRate;
+	setGains(kp, ki);
+	reset();
+}
+
+template <typename T>
+void QMC5883LMahony<T>::begin(QMC5883LCompass& compass, float kp, float ki) {
+	_compass = &compass;
+	begin((float)compass._odrHz(), kp, ki);
+}
+
+
+/**
+	SET GAINS
+	@since v1.3.0
+**/
+template <typename T>
+void QMC5883LMahony<T>::setGains(float kp, float ki) {
+	// update() works with half the error, as in the reference implementation.
+	_kp = T(2.0f * kp);
+	_kpSettle = T(20.0f * kp);
+	_ki = T(2.0f * ki);
+}
+
+
+/**
+	RESET
+	Start over from level, facing north, with no gyro bias. For the first second after this, the
+	filter settles with 10 times the gain.
+	
+	@since v1.3.0
+**/
+template <typename T>
+void QMC5883LMahony<T>::reset() {
+	_q[0] = T(1.0f);
+	_q[1] = _q[2] = _q[3] = T(0.0f);
+	_eInt[0] = _eInt[1] = _eInt[2] = T(0.0f);
+	_settle = _rate;
+}
+
+
+/**
+	UPDATE
+	Advance the filter by one sample. Call it once for every new compass sample, e.g. when
+	readIfReady() returns true.
+	
+	g	Rotation rate in rad/s.
+	a	Accelerometer, any unit. A level sensor at rest reads (0, 0, +1g).
+	m	Magnetic field, any unit. Without it, getX(), getY() and getZ() of the compass given
+		to begin() are used, so the calibrated and smoothed field.
+	
+	All three must be in the axes of the compass. If a or m is a zero vector, that correction
+	is skipped for this step.
+	
+	@since v1.3.0
+**/
+template <typename T>
+void QMC5883LMahony<T>::update(T gx, T gy, T gz, T ax, T ay, T az) {
+	T mx = T(0.0f), my = T(0.0f), mz = T(0.0f);
+	if ( _compass ) {
+		_fromInt(mx, _compass->getX());
+		_fromInt(my, _compass->getY());
+		_fromInt(mz, _compass->getZ());
+	}
+	update(gx, gy, gz, ax, ay, az, mx, my, mz);
+}
+
+template <typename T>
+void QMC5883LMahony<T>::update(T gx, T gy, T gz, T ax, T ay, T az, T mx, T my, T mz) {
+	const T half = T(0.5f);
+	T q0 = _q[0], q1 = _q[1], q2 = _q[2], q3 = _q[3];
+	T q0q0 = q0 * q0, q0q1 = q0 * q1, q0q2 = q0 * q2, q0q3 = q0 * q3;
+	T q1q1 = q1 * q1, q1q2 = q1 * q2, q1q3 = q1 * q3;
+	T q2q2 = q2 * q2, q2q3 = q2 * q3, q3q3 = q3 * q3;
+	T ex = T(0.0f), ey = T(0.0f), ez = T(0.0f);
+	
+	// Measured gravity against the gravity the estimate expects, at half length.
+	T vx = q1q3 - q0q2;
+	T vy = q0q1 + q2q3;
+	T vz = q0q0 - half + q3q3;
+	if ( _normalize(ax, ay, az) ) {
+		ex += ay * vz - az * vy;
+		ey += az * vx - ax * vz;
+		ez += ax * vy - ay * vx;
+	}
+	
+	// The field is turned into the earth frame, its horizontal part laid onto north, and
+	// turned back to give the field the estimate expects. Near the magnetic poles, where the
+	// horizontal part is under 10% of the field, there is no useful heading and it's skipped.
+	T hx = T(0.0f), hy = T(0.0f), hh = T(0.0f);
+	if ( _normalize(mx, my, mz) ) {
+		hx = mx * (half - q2q2 - q3q3) + my * (q1q2 - q0q3) + mz * (q1q3 + q0q2);
+		hy = mx * (q1q2 + q0q3) + my * (half - q1q1 - q3q3) + mz * (q2q3 - q0q1);
+		hh = hx * hx + hy * hy;
+	}
+	if ( hh > T(0.0025f) ) {
+		T n = _invSqrt(hh);
+		T bx = hh * n;
+		T bz = mx * (q1q3 - q0q2) + my * (q2q3 + q0q1) + mz * (half - q1q1 - q2q2);
+		bx += bx;
+		bz += bz;
+		T wx = bx * (half - q2q2 - q3q3) + bz * (q1q3 - q0q2);
+		T wy = bx * (q1q2 - q0q3) + bz * (q0q1 + q2q3);
+		T wz = bx * (q0q2 + q1q3) + bz * (half - q1q1 - q2q2);
+		T mex = my * wz - mz * wy;
+		T mey = mz * wx - mx * wz;
+		T mez = mx * wy - my * wx;
+		
+		// Only keep the part of the error that turns about the vertical, so a disturbed or
+		// steep field can't tilt the estimate, that is up to the accelerometer. It is scaled
+		// by the horizontal field, so the heading settles as fast as the tilt anywhere on earth.
+		T d = (mex * vx + mey * vy + mez * vz) * n * n;
+		ex += d * vx;
+		ey += d * vy;
+		ez += d * vz;
+	}
+	
+	if ( _ki > T(0.0f) ) {
+		_eInt[0] += _ki * ex * _dt;
+		_eInt[1] += _ki * ey * _dt;
+		_eInt[2] += _ki * ez * _dt;
+		gx += _eInt[0];
+		gy += _eInt[1];
+		gz += _eInt[2];
+	}
+	// Settle on the first second of samples with a higher gain, since the estimate starts
+	// out facing north.
+	T kp = _kp;
+	if ( _settle ) {
+		_settle--;
+		kp = _kpSettle;
+	}
+	gx += kp * ex;
+	gy += kp * ey;
+	gz += kp * ez;
+	
+	// One fixed step of q' = q * (0, g) / 2.
+	gx = gx * _halfDt;
+	gy = gy * _halfDt;
+	gz = gz * _halfDt;
+	q0 = _q[0] - q1 * gx - q2 * gy - q3 * gz;
+	q1 = _q[1] + _q[0] * gx + q2 * gz - q3 * gy;
+	q2 = _q[2] + _q[0] * gy - _q[1] * gz + q3 * gx;
+	q3 = _q[3] + _q[0] * gz + _q[1] * gy - _q[2] * gx;
+	
+	T n = _invSqrt(q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3);
+	_q[0] = q0 * n;
+	_q[1] = q1 * n;
+	_q[2] = q2 * n;
+	_q[3] = q3 * n;
+}
+
+
+/**
+	GET QUATERNION
+	The orientation as a unit quaternion that turns the compass axes into north, west and up.
+	
+	@since v1.3.0
+**/
+template <typename T>
+void QMC5883LMahony<T>::getQuaternion(T& w, T& x, T& y, T& z) {
+	w = _q[0];
+	x = _q[1];
+	y = _q[2];
+	z = _q[3];
+}
+
+
+/**
+	GET HEADING
+	The tilt compensated azimuth (in degrees) of the X axis, the same way getAzimuth() counts
+	it, corrected with the magnetic declination of the compass given to begin().
+	
+	@since v1.3.0
+	@return int heading, 0 - 359
+**/
+template <typename T>
+int QMC5883LMahony<T>::getHeading() {
+	return getHeadingCentidegrees() / 100;
+}
+
+
+/**
+	GET HEADING IN CENTIDEGREES
+	@see getHeading(). Uses the integer atan2 of the compass, accurate to 0.01 degree.
+	
+	@since v1.3.0
+	@return uint16_t heading, 0 - 35999
+**/
+template <typename T>
+uint16_t QMC5883LMahony<T>::getHeadingCentidegrees() {
+	// Yaw of the quaternion, negated since the azimuth turns clockwise.
+	const T half = T(0.5f);
+	long y = -_toLong(_q[0] * _q[3] + _q[1] * _q[2]);
+	long x = _toLong(_q[0] * _q[0] + _q[1] * _q[1] - half);
+	return _compass ? _compass->_heading(y, x) : QMC5883LCompass::_atan2(y, x);
+}
+
+
+/**
+	FLOAT MATH
+**/
+template <typename T>
+bool QMC5883LMahony<T>::_normalize(float& x, float& y, float& z) {
+	float n = x * x + y * y + z * z;
+	if ( n <= 0 ) {
+		return false;
+	}
+	n = _invSqrt(n);
+	x *= n;
+	y *= n;
+	z *= n;
+	return true;
+}
+
+template <typename T>
+float QMC5883LMahony<T>::_invSqrt(float v) {
+	return 1.0f / sqrtf(v);
+}
+
+template <typename T>
+long QMC5883LMahony<T>::_toLong(float v) {
+	return lroundf(v * 65536.0f);
+}
+
+template <typename T>
+void QMC5883LMahony<T>::_fromInt(float& out, int v) {
+	out = v;
+}
+
+
+/**
+	FIXED-POINT MATH
+	Square roots go through the integer square root of the compass. Their input is kept
+	below 4, so it can be shifted up by 14 bits for precision and still fit in 32 bits.
+**/
+template <typename T>
+bool QMC5883LMahony<T>::_normalize(QMC5883LQ16& x, QMC5883LQ16& y, QMC5883LQ16& z) {
+	// Scale the largest axis to 0.5 - 1 first, so any unit works and the squares can't overflow.
+	uint32_t m = labs(x.v);
+	if ( (uint32_t)labs(y.v) > m ) {
+		m = labs(y.v);
+	}
+	if ( (uint32_t)labs(z.v) > m ) {
+		m = labs(z.v);
+	}
+	if ( m == 0 ) {
+		return false;
+	}
+	for ( ; m >= 0x10000UL; m >>= 1 ) {
+		x.v /= 2;
+		y.v /= 2;
+		z.v /= 2;
+	}
+	for ( ; m < 0x8000UL; m <<= 1 ) {
+		x.v *= 2;
+		y.v *= 2;
+		z.v *= 2;
+	}
+	QMC5883LQ16 n = _invSqrt(x * x + y * y + z * z);
+	x = x * n;
+	y = y * n;
+	z = z * n;
+	return true;
+}
+
+template <typename T>
+QMC5883LQ16 QMC5883LMahony<T>::_invSqrt(QMC5883LQ16 v) {
+	// 1 / sqrt(v / 2^16) * 2^16 = 2^31 / sqrt(v * 2^14)
+	uint16_t s = QMC5883LCompass::_isqrt((uint32_t)v.v << 14);
+	return QMC5883LQ16::fromRaw(s ? (int32_t)((0x80000000UL + s / 2) / s) : 0);
+}
+
+template <typename T>
+long QMC5883LMahony<T>::_toLong(QMC5883LQ16 v) {
+	return v.v;
+}
+
+template <typename T>
+void QMC5883LMahony<T>::_fromInt(QMC5883LQ16& out, int v) {
+	// Only the direction matters, _normalize() scales it.
+	out = QMC5883LQ16::fromRaw(v);
+}
+
+#endif
@@ -0,0 +1,239 @@
+/*
+===============================================================================================================
+QMC5883LCompass.h Library - Binary Sample Stream
+Learn more at [https://github.com/mprograms/QMC5883LCompass]
+
+See QMC5883LStream.h for the frame layout.
+
+===============================================================================================================
+Release under the GNU General Public License v3
+[https://www.gnu.org/licenses/gpl-3.0.en.html]
+===============================================================================================================
+*/
+#include "QMC5883LStream.h"
+
+static_assert(QMC5883L_STREAM_SAMPLES >= 1 && QMC5883L_STREAM_SAMPLES <= 255,
+	"QMC5883L_STREAM_SAMPLES must be 1 - 255");
+
+QMC5883LStream::QMC5883LStream() {
+}
+
+
+/**
+	BEGIN
+	Set the Stream frames are written to, and the number of samples per frame (1 -
+	QMC5883L_STREAM_SAMPLES). Bigger frames have less overhead, smaller ones arrive sooner.
+	
+	Frames are only written as far as the stream has room for them (availableForWrite()),
+	so a stream that always reports 0 never gets any data.
+	
+	@since v1.3.0
+**/
+void QMC5883LStream::begin(Stream& out, byte samples){
+	_out = &out;
+	_samples = ( samples < 1 ) ? 1 : ( samples > QMC5883L_STREAM_SAMPLES ) ? QMC5883L_STREAM_SAMPLES : samples;
+	_count = 0;
+	_sendLength = 0;
+	_sendPos = 0;
+}
+
+
+/**
+	ADD
+	Add the current values of the compass, calibrated and smoothed as getX() etc. return them.
+	Call it once per sample, e.g. when readIfReady() returned a new one.
+	
+	Frames are sent once full. When the previous frame is still being written at that point,
+	the new frame is dropped and counted, @see getDropped(). Its sequence number is skipped so
+	the decoder sees the gap.
+	
+	@since v1.3.0
+	@return bool false if a frame was dropped
+**/
+bool QMC5883LStream::add(QMC5883LCompass& compass){
+	int16_t x, y, z;
+	compass.getXYZ(x, y, z);
+	return _add(x, y, z, compass.getStatus(), compass.getTimestamp(), QMC5883L_STREAM_CALIBRATED | compass.getRange());
+}
+
+
+/**
+	ADD RAW SAMPLE
+	Add a raw sample read from the compass with readBurst() or readSamples(), e.g. to collect
+	data for an offline calibration.
+	
+	@since v1.3.0
+	@return bool false if a frame was dropped
+**/
+bool QMC5883LStream::add(QMC5883LCompass& compass, const QMC5883LSample& sample){
+	return _add(sample.x, sample.y, sample.z, sample.status, sample.t, compass.getRange());
+}
+
+
+/**
+	FLUSH
+	Send the samples collected so far without waiting for the frame to fill up.
+	
+	@since v1.3.0
+	@return bool false if the previous frame was still being written and the samples were dropped
+**/
+bool QMC5883LStream::flush(){
+	return _seal();
+}
+
+
+/**
+	UPDATE
+	Write as much of the pending frame as the stream takes without blocking. add() already does
+	this, call it from loop() as well when samples arrive slower than the stream drains.
+	
+	@since v1.3.0
+	@return bool true when everything has been written
+**/
+bool QMC5883LStream::update(){
+	while ( _out && _sendPos < _sendLength ) {
+		int room = _out->availableForWrite();
+		if ( room <= 0 ) {
+			break;
+		}
+		size_t n = _sendLength - _sendPos;
+		if ( (size_t)room < n ) {
+			n = room;
+		}
+		n = _out->write(_frame[_fill ^ 1] + _sendPos, n);
+		if ( n == 0 ) {
+			break;
+		}
+		_sendPos += n;
+	}
+	return _sendPos >= _sendLength;
+}
+
+
+/**
+	GET SEQUENCE
+	Sequence number of the next frame.
+	
+	@since v1.3.0
+**/
+uint16_t QMC5883LStream::getSequence(){
+	return _sequence;
+}
+
+
+/**
+	GET DROPPED
+	Number of samples dropped because the stream could not keep up.
+	
+	@since v1.3.0
+**/
+uint32_t QMC5883LStream::getDropped(){
+	return _dropped;
+}
+
+
+/**
+	ADD SAMPLE
+	Append a sample to the frame being filled. A change of the flags (range or calibrated) starts
+	a new frame, so every frame holds one kind of values.
+	
+	@since v1.3.0
+**/
+bool QMC5883LStream::_add(int16_t x, int16_t y, int16_t z, uint8_t status, uint32_t t, uint8_t flags){
+	bool ok = true;
+	update();
+	if ( _count && flags != _flags ) {
+		ok = _seal();
+	}
+	
+	uint8_t* frame = _frame[_fill];
+	int16_t v[3] = {x, y, z};
+	if ( _count == 0 ) {
+		_flags = flags;
+		_status = 0;
+		_first = t;
+		_length = 14;
+		for ( int i = 0; i < 3; i++ ) {
+			_put16(frame + _length, v[i]);
+			_length += 2;
+		}
+	} else {
+		long d[3];
+		bool small = true;
+		for ( int i = 0; i < 3; i++ ) {
+			d[i] = (long)v[i] - _prev[i];
+			small &= ( d[i] >= -127 && d[i] <= 127 );
+		}
+		if ( small ) {
+			for ( int i = 0; i < 3; i++ ) {
+				frame[_length++] = (int8_t)d[i];
+			}
+		} else {
+			frame[_length++] = 0x80;
+			for ( int i = 0; i < 3; i++ ) {
+				_put16(frame + _length, v[i]);
+				_length += 2;
+			}
+		}
+	}
+	_prev[0] = x;
+	_prev[1] = y;
+	_prev[2] = z;
+	_status |= status;
+	_last = t;
+	_count++;
+	
+	if ( _count >= _samples ) {
+		ok &= _seal();
+	}
+	return ok;
+}
+
+
+/**
+	SEAL
+	Finish the header and CRC of the frame being filled and hand it to the writer. Drops it when
+	the writer is still busy with the previous frame.
+	
+	@since v1.3.0
+	@return bool false if the frame was dropped
+**/
+bool QMC5883LStream::_seal(){
+	if ( _count == 0 ) {
+		return true;
+	}
+	
+	bool ok = update();
+	if ( ok ) {
+		uint8_t* frame = _frame[_fill];
+		frame[0] = 0xA5;
+		frame[1] = 0x5A;
+		frame[2] = QMC5883L_STREAM_VERSION;
+		frame[3] = _flags;
+		_put16(frame + 4, _sequence);
+		frame[6] = _count;
+		frame[7] = _status;
+		for ( int i = 0; i < 4; i++ ) {
+			frame[8 + i] = _first >> (i * 8);
+		}
+		uint32_t interval = ( _count > 1 ) ? (_last - _first) / (_count - 1) : 0;
+		_put16(frame + 12, ( interval > 65535 ) ? 65535 : interval);
+		_put16(frame + _length, QMC5883LCompass::crc16(frame + 2, _length - 2));
+		
+		_sendLength = _length + 2;
+		_sendPos = 0;
+		_fill ^= 1;
+	} else {
+		_dropped += _count;
+	}
+	_sequence++;
+	_count = 0;
+	update();
+	return ok;
+}
+
+
+void QMC5883LStream::_put16(uint8_t* p, uint16_t v){
+	p[0] = v;
+	p[1] = v >> 8;
+}
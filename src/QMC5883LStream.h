@@ -0,0 +1,92 @@
+/*
+===============================================================================================================
+QMC5883LCompass.h Library - Binary Sample Stream
+Learn more at [https://github.com/mprograms/QMC5883LCompass]
+
+Packs compass samples into small CRC checked frames and writes them to a Serial port (or any other Stream)
+without blocking, so every sample of the 200Hz data rate can be logged for offline calibration. Samples are
+delta encoded: a sample that moved less than 128 counts on every axis takes 3 bytes instead of 6.
+
+Frames are decoded on the computer with extras/stream/qmc5883l_stream.py.
+
+FRAME LAYOUT (little endian)
+
+	0	2	sync, 0xA5 0x5A
+	2	1	version, QMC5883L_STREAM_VERSION
+	3	1	flags, bit 0 = calibrated values (raw when 0), bits 4-5 = RNG of the chip (0x10 = 8G)
+	4	2	sequence number, counts every frame including dropped ones
+	6	1	number of samples
+	7	1	STATUS bits of all samples OR'ed together
+	8	4	micros() timestamp of the first sample
+	12	2	mean time between samples in us, 0 with one sample
+	14	6	first sample, x, y, z int16
+	20		every other sample, either 3 int8 deltas to the previous one (-127 - 127), or 0x80
+			followed by x, y, z int16
+	end	2	CRC-16/CCITT-FALSE of bytes 2 up to the CRC, @see QMC5883LCompass::crc16()
+
+===============================================================================================================
+Release under the GNU General Public License v3
+[https://www.gnu.org/licenses/gpl-3.0.en.html]
+===============================================================================================================
+*/
+#ifndef QMC5883L_Stream
+#define QMC5883L_Stream
+
+#include "Arduino.h"
+#include "QMC5883LCompass.h"
+
+/**
+	STREAM SAMPLES
+	Largest number of samples per frame. Two frames are buffered, one being filled while the
+	other is written, which takes 2 * (22 + 7 * (QMC5883L_STREAM_SAMPLES - 1)) bytes of RAM.
+**/
+#ifndef QMC5883L_STREAM_SAMPLES
+#define QMC5883L_STREAM_SAMPLES 16
+#endif
+
+#define QMC5883L_STREAM_VERSION 1
+
+#define QMC5883L_STREAM_CALIBRATED	0x01
+
+#define QMC5883L_STREAM_FRAME_SIZE (22 + 7 * (QMC5883L_STREAM_SAMPLES - 1))
+
+
+class QMC5883LStream {
+	
+  public:
+	QMC5883LStream();
+	void begin(Stream& out, byte samples = QMC5883L_STREAM_SAMPLES);
+	bool add(QMC5883LCompass& compass);
+	bool add(QMC5883LCompass& compass, const QMC5883LSample& sample);
+	bool flush();
+	bool update();
+	uint16_t getSequence();
+	uint32_t getDropped();
+	
+  private:
+	bool _add(int16_t x, int16_t y, int16_t z, uint8_t status, uint32_t t, uint8_t flags);
+	bool _seal();
+	void _put16(uint8_t* p, uint16_t v);
+	Stream* _out = nullptr;
+	byte _samples = QMC5883L_STREAM_SAMPLES;
+	uint8_t _frame[2][QMC5883L_STREAM_FRAME_SIZE];
+	
+	// Frame being filled.
+	uint8_t _fill = 0;
+	uint16_t _length = 0;
+	byte _count = 0;
+	uint8_t _flags = 0;
+	uint8_t _status = 0;
+	uint32_t _first = 0;
+	uint32_t _last = 0;
+	int16_t _prev[3] = {0,0,0};
+	
+	// Frame being written, the other one.
+	uint16_t _sendLength = 0;
+	uint16_t _sendPos = 0;
+	
+	uint16_t _sequence = 0;
+	uint32_t _dropped = 0;
+};
+
+#endif